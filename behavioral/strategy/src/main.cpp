@@ -13,102 +13,4371 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <list>
 #include <memory>
+#include <memory_resource>
+#include <new>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <variant>
 #include <vector>
 
+// AllocationCounter: counts global operator new calls so the examples can report allocations per payment
+struct AllocationCounter {
+    static inline std::atomic<uint64_t> allocations{0};
+    static uint64_t count() { return allocations.load(std::memory_order_relaxed); }
+};
+
+// Out of line so GCC does not pair an inlined free() with a visible operator new call and warn
+__attribute__((noinline)) void *operator new(std::size_t size)
+{
+    AllocationCounter::allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void *operator new(std::size_t size, std::align_val_t align)
+{
+    AllocationCounter::allocations.fetch_add(1, std::memory_order_relaxed);
+    auto alignment = static_cast<std::size_t>(align);
+    std::size_t rounded = (std::max<std::size_t>(size, 1) + alignment - 1) / alignment * alignment;
+    if (void *p = std::aligned_alloc(alignment, rounded)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+__attribute__((noinline)) void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+__attribute__((noinline)) void operator delete(void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+__attribute__((noinline)) void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+constexpr size_t nextPowerOfTwo(size_t n)
+{
+    size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+// splitmix64 finalizer: spreads sequential or clustered ids over all 64 bits before they pick a bucket
+constexpr uint64_t mix64(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Swar: tests on the 8 bytes of a uint64_t at once. Each returns a word with the high bit set in every
+// byte that matches, so matches can be walked with ctz or counted with popcount.
+struct Swar {
+    static constexpr uint64_t kLowBits = 0x0101010101010101ULL;
+    static constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+
+    // Every byte equal to c
+    static constexpr uint64_t equal(uint64_t word, uint8_t c)
+    {
+        uint64_t x = word ^ (kLowBits * c);
+        return ~(((x & ~kHighBits) + ~kHighBits) | x) & kHighBits;
+    }
+    // Every byte equal to c, plus possibly false positives above a true match; cheaper than equal() and
+    // enough for a probe that confirms each candidate anyway
+    static constexpr uint64_t equalCandidates(uint64_t word, uint8_t c)
+    {
+        uint64_t x = word ^ (kLowBits * c);
+        return (x - kLowBits) & ~x & kHighBits;
+    }
+    // Every ASCII byte below c (c <= 0x80); subtracting from bytes with the high bit forced on cannot
+    // borrow into the neighbouring byte
+    static constexpr uint64_t below(uint64_t word, uint8_t c)
+    {
+        return ~((word | kHighBits) - kLowBits * c) & kHighBits;
+    }
+    static constexpr uint64_t inRange(uint64_t word, uint8_t lo, uint8_t hi)
+    {
+        return below(word, hi + 1) & ~below(word, lo);
+    }
+};
+
+// Amount: money value rendered as fixed two-decimal dollars by ReceiptWriter
+struct Amount {
+    double value;
+};
+
+// ReceiptWriter: renders receipts into a reusable per-thread buffer and hands it to the output stream in
+// one write once batchSize() receipts are pending. Nothing is flushed per line and the stream's
+// formatting state (std::fixed, precision) is left untouched.
+class ReceiptWriter {
+public:
+    static ReceiptWriter &forThread()
+    {
+        thread_local ReceiptWriter writer;
+        return writer;
+    }
+    ~ReceiptWriter() { flush(); }
+
+    // Receipts per write; 1 writes each receipt as soon as it is complete
+    static void setBatchSize(size_t receipts) { batch_size_.store(std::max<size_t>(receipts, 1)); }
+    // nullptr discards receipts (null sink for benchmarks); call flush() on each thread before switching
+    static void setOutput(std::ostream *out) { output_.store(out); }
+
+    template <typename... Parts>
+    ReceiptWriter &line(const Parts &...parts)
+    {
+        (append(parts), ...);
+        buffer_ += '\n';
+        return *this;
+    }
+    void endReceipt()
+    {
+        if (++pending_ >= batch_size_.load(std::memory_order_relaxed)) {
+            flush();
+        }
+    }
+    void flush()
+    {
+        if (std::ostream *out = output_.load(std::memory_order_relaxed); out && !buffer_.empty()) {
+            out->write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+            out->flush();
+        }
+        buffer_.clear(); // keeps its capacity for the next batch
+        pending_ = 0;
+    }
+
+private:
+    ReceiptWriter() { buffer_.reserve(4096); }
+
+    void append(std::string_view text) { buffer_.append(text); }
+    void append(char c) { buffer_ += c; }
+    // Integer cents to decimal digits; exact, and much cheaper than iostream float formatting
+    void append(Amount amount)
+    {
+        int64_t cents = std::llround(amount.value * 100.0);
+        if (cents < 0) {
+            buffer_ += '-';
+            cents = -cents;
+        }
+        char digits[24];
+        char *end = digits + sizeof(digits), *p = end;
+        *--p = static_cast<char>('0' + cents % 10);
+        *--p = static_cast<char>('0' + cents / 10 % 10);
+        *--p = '.';
+        int64_t whole = cents / 100;
+        do {
+            *--p = static_cast<char>('0' + whole % 10);
+            whole /= 10;
+        } while (whole);
+        buffer_.append(p, static_cast<size_t>(end - p));
+    }
+
+    std::string buffer_;
+    size_t pending_ = 0;
+    static inline std::atomic<size_t> batch_size_{1};
+    static inline std::atomic<std::ostream *> output_{&std::cout};
+};
+
 // PaymentStrategy interface
 class PaymentStrategy {
 public:
     virtual ~PaymentStrategy() = default;
     virtual bool pay(double amount) const = 0;
     virtual std::string getName() const = 0;
+    // Reverses a successful pay(); strategies that cannot refund return false
+    virtual bool refund(double /*amount*/) const { return false; }
+    // True if repeating pay() for one payment cannot charge twice, e.g. the gateway deduplicates by request id
+    virtual bool isIdempotent() const { return false; }
+    // Authorizes several payments in one call; gateways that support batching override this
+    virtual std::vector<bool> payBatch(const std::vector<double> &amounts) const
+    {
+        std::vector<bool> results;
+        results.reserve(amounts.size());
+        for (double amount : amounts) {
+            results.push_back(pay(amount));
+        }
+        return results;
+    }
 };
 
 // CreditCardPayment
 class CreditCardPayment : public PaymentStrategy {
 public:
-    CreditCardPayment(std::string card_number, std::string card_holder, std::string cvv)
-        : card_number_(std::move(card_number)), card_holder_(std::move(card_holder)), cvv_(std::move(cvv))
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    CreditCardPayment(std::string_view card_number, std::string_view card_holder, std::string_view cvv,
+                      allocator_type alloc = {})
+        : card_number_(card_number, alloc), card_holder_(card_holder, alloc), cvv_(cvv, alloc)
     {
     }
     bool pay(double amount) const override
     {
-        std::cout << "💳 Processing credit card payment:" << std::endl;
-        std::cout << "   Card: " << card_number_.substr(0, 4) << "****" << card_number_.substr(card_number_.size() - 4)
-                  << std::endl;
-        std::cout << "   Holder: " << card_holder_ << std::endl;
-        std::cout << "   CVV: " << std::string(cvv_.length(), '*') << std::endl;
-        std::cout << "   Amount: $" << std::fixed << std::setprecision(2) << amount << std::endl;
-        std::cout << "   ✅ Credit card payment successful!" << std::endl;
+        std::string_view card = card_number_;
+        ReceiptWriter::forThread()
+            .line("💳 Processing credit card payment:")
+            .line("   Card: ", card.substr(0, 4), "****", card.substr(card.size() - 4))
+            .line("   Holder: ", std::string_view(card_holder_))
+            .line("   CVV: ", std::string_view("****************", std::min<size_t>(cvv_.size(), 16)))
+            .line("   Amount: $", Amount{amount})
+            .line("   ✅ Credit card payment successful!")
+            .endReceipt();
+        return true;
+    }
+    bool refund(double amount) const override
+    {
+        std::string_view card = card_number_;
+        ReceiptWriter::forThread()
+            .line("↩️ Refunding $", Amount{amount}, " to card ending ", card.substr(card.size() - 4))
+            .endReceipt();
         return true;
     }
     std::string getName() const override { return "Credit Card"; }
 
 private:
-    std::string card_number_, card_holder_, cvv_;
+    std::pmr::string card_number_, card_holder_, cvv_;
+};
+
+// FlatHashMap64: open-addressing uint64 -> uint64 map in Swiss-table style. One control byte per slot
+// holds 7 hash bits (or kEmpty); a probe compares 8 control bytes at once with SWAR bit tricks and only
+// touches slots whose tag matches. The arrays can also be a read-only view into a mapped snapshot.
+class FlatHashMap64 {
+public:
+    static constexpr size_t kGroup = 8;
+
+    struct Slot {
+        uint64_t key, value;
+    };
+
+    explicit FlatHashMap64(size_t capacity = 64) { allocate(nextPowerOfTwo(std::max(capacity, kGroup))); }
+    FlatHashMap64(const uint8_t *ctrl, const Slot *slots, size_t capacity, size_t size)
+        : ctrl_(ctrl), slots_(slots), capacity_(capacity), size_(size)
+    {
+    }
+
+    void reserve(size_t n)
+    {
+        size_t needed = nextPowerOfTwo(std::max(n + n / 7 + 1, kGroup));
+        if (needed > capacity_) {
+            rehash(needed);
+        }
+    }
+
+    const uint64_t *find(uint64_t key) const
+    {
+        uint64_t h = mix64(key);
+        auto tag = static_cast<uint8_t>(h & 0x7f);
+        size_t mask = capacity_ / kGroup - 1;
+        for (size_t group = (h >> 7) & mask, step = 0;; group = (group + ++step) & mask) {
+            uint64_t word = loadGroup(group);
+            // False positives are resolved by the key compare
+            for (uint64_t m = Swar::equalCandidates(word, tag); m; m &= m - 1) {
+                const Slot &slot = slots_[group * kGroup + (__builtin_ctzll(m) >> 3)];
+                if (slot.key == key) {
+                    return &slot.value;
+                }
+            }
+            if (word & Swar::kHighBits) { // an empty byte ends the probe sequence
+                return nullptr;
+            }
+        }
+    }
+
+    // Returns false if the key is already present
+    bool insert(uint64_t key, uint64_t value)
+    {
+        if (find(key)) {
+            return false;
+        }
+        if (owned_ctrl_.empty()) { // mapped snapshot: copy before the first write
+            rehash(capacity_);
+        }
+        if ((size_ + 1) * 8 > capacity_ * 7) {
+            rehash(capacity_ * 2);
+        }
+        place(key, value);
+        return true;
+    }
+
+    // Whether ctrl[0, capacity) can back a map of `size` entries: every byte is kEmpty or a 7-bit tag and
+    // exactly `size` are tags. With size < capacity some byte is empty, so every probe terminates.
+    // Checked a group at a time; capacity is a multiple of kGroup.
+    static bool validControl(const uint8_t *ctrl, size_t capacity, size_t size)
+    {
+        size_t empty = 0;
+        for (size_t i = 0; i < capacity; i += kGroup) {
+            uint64_t word;
+            std::memcpy(&word, ctrl + i, sizeof(word));
+            uint64_t high = word & Swar::kHighBits;
+            if (word & ((high >> 7) * 0xff) & ~Swar::kHighBits) { // a byte with the high bit set other than kEmpty
+                return false;
+            }
+            empty += static_cast<size_t>(__builtin_popcountll(high));
+        }
+        return capacity - empty == size && size < capacity;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    const uint8_t *ctrl() const { return ctrl_; }
+    const Slot *slots() const { return slots_; }
+
+private:
+    static constexpr uint8_t kEmpty = 0x80;
+    uint64_t loadGroup(size_t group) const
+    {
+        uint64_t word;
+        std::memcpy(&word, ctrl_ + group * kGroup, sizeof(word));
+        return word;
+    }
+
+    void allocate(size_t capacity)
+    {
+        owned_ctrl_.assign(capacity, kEmpty);
+        owned_slots_.assign(capacity, Slot{0, 0});
+        ctrl_ = owned_ctrl_.data();
+        slots_ = owned_slots_.data();
+        capacity_ = capacity;
+        size_ = 0;
+    }
+    void rehash(size_t capacity)
+    {
+        std::vector<uint8_t> old_ctrl(ctrl_, ctrl_ + capacity_);
+        std::vector<Slot> old_slots(slots_, slots_ + capacity_);
+        allocate(capacity);
+        for (size_t i = 0; i < old_ctrl.size(); ++i) {
+            if (old_ctrl[i] != kEmpty) {
+                place(old_slots[i].key, old_slots[i].value);
+            }
+        }
+    }
+    void place(uint64_t key, uint64_t value)
+    {
+        uint64_t h = mix64(key);
+        size_t mask = capacity_ / kGroup - 1;
+        for (size_t group = (h >> 7) & mask, step = 0;; group = (group + ++step) & mask) {
+            uint64_t empties = loadGroup(group) & Swar::kHighBits;
+            if (empties) {
+                size_t index = group * kGroup + (__builtin_ctzll(empties) >> 3);
+                owned_ctrl_[index] = static_cast<uint8_t>(h & 0x7f);
+                owned_slots_[index] = Slot{key, value};
+                ++size_;
+                return;
+            }
+        }
+    }
+
+    std::vector<uint8_t> owned_ctrl_;
+    std::vector<Slot> owned_slots_;
+    const uint8_t *ctrl_ = nullptr;
+    const Slot *slots_ = nullptr;
+    size_t capacity_ = 0, size_ = 0;
+};
+
+// TokenVault: swaps card numbers (PANs) for opaque tokens and back. A token is a keyed bijection of an
+// issue counter, so tokens never collide. save() writes both tables as one flat file that load() maps
+// read-only and uses in place. The snapshot holds PANs, so it is created owner-only (0600), and the
+// tokenization key is never written to it: the caller keeps the key and passes it to the restoring vault.
+class TokenVault {
+public:
+    TokenVault() : TokenVault(std::random_device{}() | (static_cast<uint64_t>(std::random_device{}()) << 32)) {}
+    explicit TokenVault(uint64_t key) : key_(key) {}
+    ~TokenVault() { unmap(); }
+    TokenVault(const TokenVault &) = delete;
+    TokenVault &operator=(const TokenVault &) = delete;
+
+    void reserve(size_t tokens)
+    {
+        by_pan_.reserve(tokens);
+        by_token_.reserve(tokens);
+    }
+
+    uint64_t tokenize(std::string_view pan)
+    {
+        uint64_t number = parsePan(pan);
+        if (const uint64_t *token = by_pan_.find(number)) {
+            return *token;
+        }
+        // A snapshot restored under another key may already hold the next token; skip it
+        uint64_t token;
+        do {
+            token = permute(next_++ ^ key_);
+        } while (by_token_.find(token));
+        by_pan_.insert(number, token);
+        by_token_.insert(token, number);
+        return token;
+    }
+    // Empty string for unknown tokens
+    std::string detokenize(uint64_t token) const
+    {
+        const uint64_t *number = by_token_.find(token);
+        return number ? std::to_string(*number) : std::string();
+    }
+    // Token for an already tokenized PAN, or 0; never allocates
+    uint64_t lookup(uint64_t pan_number) const
+    {
+        const uint64_t *token = by_pan_.find(pan_number);
+        return token ? *token : 0;
+    }
+    size_t size() const { return by_pan_.size(); }
+
+    void save(const std::filesystem::path &path) const
+    {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd >= 0 && ::fchmod(fd, 0600) != 0) { // an existing file keeps its mode on O_CREAT
+            ::close(fd);
+            fd = -1;
+        }
+        std::FILE *out = fd < 0 ? nullptr : ::fdopen(fd, "wb");
+        if (!out) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            throw std::runtime_error("cannot write token snapshot " + path.string());
+        }
+        Header header{{'T', 'O', 'K', 'V', 'A', 'U', 'L', 'T'},
+                      kSnapshotVersion,
+                      0,
+                      next_,
+                      by_pan_.capacity(),
+                      by_pan_.size(),
+                      by_token_.capacity(),
+                      by_token_.size()};
+        bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+        for (const FlatHashMap64 *map : {&by_pan_, &by_token_}) {
+            ok = ok && std::fwrite(map->ctrl(), 1, map->capacity(), out) == map->capacity() &&
+                 std::fwrite(map->slots(), sizeof(FlatHashMap64::Slot), map->capacity(), out) == map->capacity();
+        }
+        if (std::fclose(out) != 0 || !ok) {
+            throw std::runtime_error("cannot write token snapshot " + path.string());
+        }
+    }
+
+    // Keeps this vault's key; the snapshot must have been saved by a vault created with the same key
+    void load(const std::filesystem::path &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("cannot open token snapshot " + path.string());
+        }
+        size_t bytes = std::filesystem::file_size(path);
+        if (bytes < sizeof(Header)) {
+            ::close(fd);
+            throw std::runtime_error("not a token snapshot: " + path.string());
+        }
+        void *mapped = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("cannot map token snapshot " + path.string());
+        }
+        const auto *base = static_cast<const uint8_t *>(mapped);
+        Header header;
+        std::memcpy(&header, base, sizeof(header));
+        // Both tables must lie inside the file; sizes are checked against the remaining bytes so nothing wraps.
+        // A control array without an empty byte would make lookups probe forever, so it is checked as well.
+        size_t remaining = bytes - sizeof(header);
+        const uint8_t *table = base + sizeof(header);
+        auto valid = [&remaining, &table](uint64_t capacity, uint64_t size) {
+            if (capacity < FlatHashMap64::kGroup || (capacity & (capacity - 1)) != 0 || size >= capacity ||
+                capacity > remaining / kSlotBytes || !FlatHashMap64::validControl(table, capacity, size)) {
+                return false;
+            }
+            remaining -= capacity * kSlotBytes;
+            table += capacity * kSlotBytes;
+            return true;
+        };
+        if (std::memcmp(header.magic, "TOKVAULT", 8) != 0 || header.version != kSnapshotVersion ||
+            !valid(header.pan_capacity, header.pan_size) || !valid(header.token_capacity, header.token_size)) {
+            ::munmap(mapped, bytes);
+            throw std::runtime_error("not a token snapshot: " + path.string());
+        }
+        unmap();
+        mapped_ = mapped;
+        mapped_bytes_ = bytes;
+        next_ = header.next;
+        const uint8_t *cursor = base + sizeof(header);
+        by_pan_ = viewOf(cursor, header.pan_capacity, header.pan_size);
+        by_token_ = viewOf(cursor, header.token_capacity, header.token_size);
+    }
+
+private:
+    struct Header {
+        char magic[8];
+        uint64_t version, reserved, next, pan_capacity, pan_size, token_capacity, token_size;
+    };
+    static constexpr uint64_t kSnapshotVersion = 2;                        // 2: key no longer stored
+    static constexpr size_t kSlotBytes = 1 + sizeof(FlatHashMap64::Slot); // control byte + slot
+
+    static uint64_t parsePan(std::string_view pan)
+    {
+        if (pan.size() < 12 || pan.size() > 19 || pan[0] == '0') {
+            throw std::invalid_argument("invalid card number length or prefix");
+        }
+        uint64_t number = 0;
+        for (char c : pan) {
+            if (c < '0' || c > '9') {
+                throw std::invalid_argument("card number must be digits only");
+            }
+            number = number * 10 + static_cast<uint64_t>(c - '0');
+        }
+        return number;
+    }
+    static uint64_t permute(uint64_t x)
+    {
+        x = (x ^ (x >> 33)) * 0xff51afd7ed558ccdULL;
+        x = (x ^ (x >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+        return x ^ (x >> 33);
+    }
+    static FlatHashMap64 viewOf(const uint8_t *&cursor, size_t capacity, size_t size)
+    {
+        const uint8_t *ctrl = cursor;
+        const auto *slots = reinterpret_cast<const FlatHashMap64::Slot *>(cursor + capacity);
+        cursor += capacity + capacity * sizeof(FlatHashMap64::Slot);
+        return FlatHashMap64(ctrl, slots, capacity, size);
+    }
+    void unmap()
+    {
+        if (mapped_) {
+            ::munmap(mapped_, mapped_bytes_);
+            mapped_ = nullptr;
+        }
+    }
+
+    uint64_t key_;
+    uint64_t next_ = 1;
+    FlatHashMap64 by_pan_, by_token_;
+    void *mapped_ = nullptr;
+    size_t mapped_bytes_ = 0;
+};
+
+// EmailAddress: validates and canonicalizes PayPal login emails. Character classes are checked 8 bytes
+// at a time with SWAR range compares, and the domain is lowercased the same way. For providers that
+// ignore case and "+tag" suffixes in the local part (and, for Gmail, dots) those are folded as well,
+// so every spelling of one mailbox maps to the same account id.
+class EmailAddress {
+public:
+    static constexpr size_t kMaxLength = 254, kMaxLocal = 64;
+
+    // Writes the canonical form of email to out; false if email is not a valid address
+    template <typename String>
+    static bool canonicalize(std::string_view email, String &out)
+    {
+        if (email.size() < 3 || email.size() > kMaxLength) {
+            return false;
+        }
+        size_t at = findAt(email);
+        if (at == 0 || at > kMaxLocal || at + 1 >= email.size()) {
+            return false;
+        }
+        std::string_view local = email.substr(0, at), domain = email.substr(at + 1);
+        if (!validPart(local, true) || !validPart(domain, false) || domain.find('.') == std::string_view::npos) {
+            return false;
+        }
+
+        char lowered[kMaxLength];
+        std::memcpy(lowered, domain.data(), domain.size());
+        toLower(lowered, domain.size());
+        domain = std::string_view(lowered, domain.size());
+        const Provider *provider = findProvider(domain);
+        if (provider) {
+            local = local.substr(0, local.find('+'));
+            if (local.empty()) {
+                return false;
+            }
+            if (!provider->alias.empty()) {
+                domain = provider->alias;
+            }
+        }
+
+        out.assign(local.data(), local.size());
+        if (provider) {
+            toLower(out.data(), out.size());
+            if (provider->drop_dots) {
+                out.erase(std::remove(out.begin(), out.end(), '.'), out.end());
+            }
+        }
+        out.push_back('@');
+        out.append(domain.data(), domain.size());
+        return true;
+    }
+
+    // Account id of a canonical address: 64-bit FNV-1a with a splitmix finalizer
+    static uint64_t accountId(std::string_view canonical)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (char c : canonical) {
+            h = (h ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+        }
+        return mix64(h);
+    }
+
+private:
+    struct Provider {
+        std::string_view domain, alias;
+        bool drop_dots;
+    };
+    static constexpr std::array<Provider, 8> kProviders{{
+        {"gmail.com", "", true},
+        {"googlemail.com", "gmail.com", true},
+        {"outlook.com", "", false},
+        {"hotmail.com", "", false},
+        {"icloud.com", "", false},
+        {"fastmail.com", "", false},
+        {"proton.me", "", false},
+        {"protonmail.com", "", false},
+    }};
+    static const Provider *findProvider(std::string_view domain)
+    {
+        for (const Provider &provider : kProviders) {
+            if (provider.domain == domain) {
+                return &provider;
+            }
+        }
+        return nullptr;
+    }
+    // The 8-byte word of p[0, n) that covers offset i. Once fewer than 8 bytes remain, the word is re-read
+    // to end at p + n and overlaps bytes already seen, which none of the per-byte tests below mind;
+    // only inputs shorter than one word are assembled byte by byte, padded with 'a'.
+    static size_t wordStart(size_t n, size_t i) { return n >= 8 ? std::min(i, n - 8) : 0; }
+    static uint64_t wordAt(const char *p, size_t n, size_t i)
+    {
+        uint64_t word;
+        if (n >= 8) {
+            std::memcpy(&word, p + wordStart(n, i), 8);
+            return word;
+        }
+        word = Swar::kLowBits * 'a';
+        for (size_t j = 0; j < n; ++j) {
+            word = (word & ~(uint64_t{0xff} << (8 * j))) | (uint64_t{static_cast<uint8_t>(p[j])} << (8 * j));
+        }
+        return word;
+    }
+    // High bit set in every byte allowed in a local part (dot-atom subset) or a domain
+    static uint64_t allowed(uint64_t word, bool local)
+    {
+        uint64_t mask = Swar::inRange(word, 'a', 'z') | Swar::inRange(word, 'A', 'Z') |
+                        Swar::inRange(word, '0', '9') | Swar::equal(word, '.') | Swar::equal(word, '-');
+        if (local) {
+            mask |= Swar::equal(word, '+') | Swar::equal(word, '_') | Swar::equal(word, '%');
+        }
+        return mask & ~word; // non-ASCII bytes never match
+    }
+
+    static size_t findAt(std::string_view s)
+    {
+        for (size_t i = 0; i < s.size(); i += 8) {
+            if (uint64_t m = Swar::equal(wordAt(s.data(), s.size(), i), '@')) {
+                return wordStart(s.size(), i) + (__builtin_ctzll(m) >> 3);
+            }
+        }
+        return std::string_view::npos;
+    }
+    // Every byte allowed, no leading, trailing or doubled dot; a dot in the last byte of one word is
+    // carried into the next word's test (an overlapping word already holds that pair)
+    static bool validPart(std::string_view s, bool local)
+    {
+        if (s.front() == '.' || s.back() == '.') {
+            return false;
+        }
+        uint64_t carry = 0;
+        for (size_t i = 0; i < s.size(); i += 8) {
+            uint64_t word = wordAt(s.data(), s.size(), i);
+            uint64_t dots = Swar::equal(word, '.');
+            if (wordStart(s.size(), i) != i) {
+                carry = 0;
+            }
+            if (allowed(word, local) != Swar::kHighBits || (dots & ((dots << 8) | carry))) {
+                return false;
+            }
+            carry = dots >> 56;
+        }
+        return true;
+    }
+    // Sets bit 5 (0x20) in every uppercase letter: the range mask's high bit shifted right by two
+    static void toLower(char *p, size_t n)
+    {
+        for (size_t i = 0; i < n; i += 8) {
+            uint64_t word = wordAt(p, n, i);
+            word |= Swar::inRange(word, 'A', 'Z') >> 2;
+            if (n >= 8) {
+                std::memcpy(p + wordStart(n, i), &word, 8);
+            } else {
+                std::memcpy(p, &word, n);
+            }
+        }
+    }
 };
 
 // PayPalPayment
 class PayPalPayment : public PaymentStrategy {
 public:
-    PayPalPayment(std::string email) : email_(std::move(email)) {}
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    PayPalPayment(std::string_view email, allocator_type alloc = {}) : email_(email, alloc), canonical_(alloc)
+    {
+        if (!EmailAddress::canonicalize(email, canonical_)) {
+            throw std::invalid_argument("invalid PayPal email: " + std::string(email));
+        }
+        account_id_ = EmailAddress::accountId(canonical_);
+    }
     bool pay(double amount) const override
     {
-        std::cout << "📧 Processing PayPal payment:" << std::endl;
-        std::cout << "   Email: " << email_ << std::endl;
-        std::cout << "   Amount: $" << std::fixed << std::setprecision(2) << amount << std::endl;
-        std::cout << "   ✅ PayPal payment successful!" << std::endl;
+        ReceiptWriter::forThread()
+            .line("📧 Processing PayPal payment:")
+            .line("   Email: ", std::string_view(email_))
+            .line("   Amount: $", Amount{amount})
+            .line("   ✅ PayPal payment successful!")
+            .endReceipt();
+        return true;
+    }
+    bool refund(double amount) const override
+    {
+        ReceiptWriter::forThread().line("↩️ Refunding $", Amount{amount}, " to ", std::string_view(email_)).endReceipt();
         return true;
     }
     std::string getName() const override { return "PayPal"; }
+    std::string_view canonicalEmail() const { return canonical_; }
+    uint64_t accountId() const { return account_id_; }
 
 private:
-    std::string email_;
+    std::pmr::string email_, canonical_;
+    uint64_t account_id_;
 };
 
-// PaymentContext
-class PaymentContext {
+// MockGatewayPayment: silent strategy with a heavy-tailed (log-normal) latency.
+// connections limits concurrent round trips like a gateway connection pool (0 = unlimited).
+class MockGatewayPayment : public PaymentStrategy {
 public:
-    void setPaymentStrategy(std::unique_ptr<PaymentStrategy> strategy) { payment_strategy_ = std::move(strategy); }
-    bool processPayment(double amount) const
+    MockGatewayPayment(std::chrono::microseconds median, double sigma, double failure_rate = 0.0,
+                       size_t connections = 0)
+        : median_us_(static_cast<double>(median.count())), sigma_(sigma), failure_rate_(failure_rate),
+          connections_(connections)
     {
-        if (payment_strategy_) {
-            std::cout << "💳 Using " << payment_strategy_->getName() << " payment method" << std::endl;
-            return payment_strategy_->pay(amount);
-        } else {
-            std::cout << "❌ No payment method selected!" << std::endl;
-            return false;
+    }
+    bool pay(double /*amount*/) const override
+    {
+        roundTrip();
+        return approve();
+    }
+    bool refund(double /*amount*/) const override
+    {
+        roundTrip();
+        return true;
+    }
+    // One round trip authorizes the whole batch
+    std::vector<bool> payBatch(const std::vector<double> &amounts) const override
+    {
+        roundTrip();
+        std::vector<bool> results(amounts.size());
+        for (size_t i = 0; i < results.size(); ++i) {
+            results[i] = approve();
         }
+        return results;
     }
+    // The mock gateway deduplicates by request id, so a repeated attempt never charges twice
+    bool isIdempotent() const override { return true; }
+    std::string getName() const override { return "Mock Gateway"; }
 
 private:
-    std::unique_ptr<PaymentStrategy> payment_strategy_;
+    static std::mt19937_64 &rng()
+    {
+        thread_local std::mt19937_64 engine{std::random_device{}()};
+        return engine;
+    }
+    void roundTrip() const
+    {
+        if (connections_ != 0) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return in_flight_ < connections_; });
+            ++in_flight_;
+        }
+        if (median_us_ > 0) {
+            std::lognormal_distribution<double> latency(std::log(median_us_), sigma_);
+            std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(latency(rng()))));
+        }
+        if (connections_ != 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --in_flight_;
+            cv_.notify_one();
+        }
+    }
+    bool approve() const { return std::uniform_real_distribution<double>(0.0, 1.0)(rng()) >= failure_rate_; }
+
+    double median_us_, sigma_, failure_rate_;
+    size_t connections_;
+    mutable std::mutex mutex_;
+    mutable std::condition_variable cv_;
+    mutable size_t in_flight_ = 0;
 };
 
-int main()
-{
-    std::cout << "💳 Strategy Pattern Example - Payment System" << std::endl;
-    std::cout << std::string(40, '=') << std::endl;
+// UnavailableGatewayPayment: a gateway that is down; every call throws instead of declining
+class UnavailableGatewayPayment : public PaymentStrategy {
+public:
+    bool pay(double /*amount*/) const override { throw std::runtime_error("gateway unavailable"); }
+    bool refund(double /*amount*/) const override { throw std::runtime_error("gateway unavailable"); }
+    std::string getName() const override { return "Unavailable Gateway"; }
+};
 
-    PaymentContext payment_context;
-    double amount = 120.50;
+// PaymentDetails: request fields a strategy factory may need; views into the request, never copied here
+struct PaymentDetails {
+    std::string_view card_number, card_holder, cvv, email;
+};
 
-    std::cout << "💰 Processing payment of $" << std::fixed << std::setprecision(2) << amount << std::endl;
-    std::cout << std::endl;
+// PerfectHashIndex: maps N distinct keys to table slots without collisions. The FNV-1a seed is searched
+// at compile time, so a lookup is one hash plus one key comparison.
+template <size_t N, size_t TableSize = nextPowerOfTwo(2 * N)>
+class PerfectHashIndex {
+public:
+    static_assert(N < 128 && (TableSize & (TableSize - 1)) == 0, "TableSize must be a power of two");
 
-    // Test Credit Card payment
-    std::cout << "🔄 Using Credit Card:" << std::endl;
-    payment_context.setPaymentStrategy(std::make_unique<CreditCardPayment>("1234567890123456", "John Doe", "123"));
-    payment_context.processPayment(amount);
-    std::cout << std::endl;
+    constexpr explicit PerfectHashIndex(const std::array<std::string_view, N> &keys) : seed_(0), slots_{}
+    {
+        for (;; ++seed_) {
+            if (seed_ > (1u << 20)) {
+                throw std::logic_error("no perfect hash seed found");
+            }
+            for (auto &slot : slots_) {
+                slot = -1;
+            }
+            bool collision = false;
+            for (size_t i = 0; i < N && !collision; ++i) {
+                int8_t &slot = slots_[hash(keys[i], seed_) & (TableSize - 1)];
+                collision = slot >= 0;
+                slot = static_cast<int8_t>(i);
+            }
+            if (!collision) {
+                return;
+            }
+        }
+    }
+    // Candidate index for key; the caller compares the key stored at that index
+    constexpr int find(std::string_view key) const { return slots_[hash(key, seed_) & (TableSize - 1)]; }
 
-    // Test PayPal payment
-    std::cout << "🔄 Using PayPal:" << std::endl;
-    payment_context.setPaymentStrategy(std::make_unique<PayPalPayment>("john.doe@example.com"));
-    payment_context.processPayment(amount);
+    static constexpr uint32_t hash(std::string_view key, uint32_t seed)
+    {
+        uint32_t h = 2166136261u ^ seed;
+        for (char c : key) {
+            h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        return h;
+    }
+
+private:
+    uint32_t seed_;
+    std::array<int8_t, TableSize> slots_;
+};
+
+// Strategy factories keyed by getName()
+struct StrategyFactory {
+    std::string_view name;
+    std::unique_ptr<PaymentStrategy> (*create)(const PaymentDetails &details);
+};
+
+constexpr std::array<StrategyFactory, 3> kStrategyFactories{{
+    {"Credit Card",
+     [](const PaymentDetails &d) -> std::unique_ptr<PaymentStrategy> {
+         return std::make_unique<CreditCardPayment>(d.card_number, d.card_holder, d.cvv);
+     }},
+    {"PayPal",
+     [](const PaymentDetails &d) -> std::unique_ptr<PaymentStrategy> {
+         return std::make_unique<PayPalPayment>(d.email);
+     }},
+    {"Mock Gateway",
+     [](const PaymentDetails &) -> std::unique_ptr<PaymentStrategy> {
+         return std::make_unique<MockGatewayPayment>(std::chrono::microseconds(0), 0.0);
+     }},
+}};
+
+constexpr std::array<std::string_view, kStrategyFactories.size()> strategyNames()
+{
+    std::array<std::string_view, kStrategyFactories.size()> names{};
+    for (size_t i = 0; i < names.size(); ++i) {
+        names[i] = kStrategyFactories[i].name;
+    }
+    return names;
+}
+
+// StrategyRegistry: resolves a payment method name to its factory without allocating
+class StrategyRegistry {
+public:
+    static const StrategyFactory *find(std::string_view name)
+    {
+        int index = kIndex.find(name);
+        return index >= 0 && kStrategyFactories[index].name == name ? &kStrategyFactories[index] : nullptr;
+    }
+    static std::unique_ptr<PaymentStrategy> create(std::string_view name, const PaymentDetails &details)
+    {
+        const StrategyFactory *factory = find(name);
+        return factory ? factory->create(details) : nullptr;
+    }
+
+private:
+    static constexpr PerfectHashIndex<kStrategyFactories.size()> kIndex{strategyNames()};
+};
+
+// LatencyHistogram: lock-free log-linear histogram, 4 sub-buckets per power of two microseconds
+class LatencyHistogram {
+public:
+    static constexpr size_t kBuckets = 128;
+
+    void record(std::chrono::nanoseconds latency)
+    {
+        auto us = static_cast<uint64_t>(std::max<int64_t>(latency.count() / 1000, 0));
+        buckets_[bucketFor(us)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    std::chrono::microseconds percentile(double p) const
+    {
+        std::array<uint64_t, kBuckets> counts{};
+        for (size_t b = 0; b < kBuckets; ++b) {
+            counts[b] = buckets_[b].load(std::memory_order_relaxed);
+        }
+        return percentileOf(counts, p);
+    }
+
+    static std::chrono::microseconds percentileOf(const std::array<uint64_t, kBuckets> &counts, double p)
+    {
+        uint64_t total = 0;
+        for (uint64_t c : counts) {
+            total += c;
+        }
+        if (total == 0) {
+            return std::chrono::microseconds(0);
+        }
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p * static_cast<double>(total)));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < kBuckets; ++b) {
+            seen += counts[b];
+            if (seen >= rank && seen > 0) {
+                return std::chrono::microseconds(bucketUpperBound(b));
+            }
+        }
+        return std::chrono::microseconds(bucketUpperBound(kBuckets - 1));
+    }
+
+    static size_t bucketFor(uint64_t us)
+    {
+        if (us < 4) {
+            return static_cast<size_t>(us);
+        }
+        size_t exponent = 63 - static_cast<size_t>(__builtin_clzll(us));
+        size_t index = 4 * (exponent - 1) + static_cast<size_t>((us >> (exponent - 2)) & 3);
+        return std::min(index, kBuckets - 1);
+    }
+    static uint64_t bucketUpperBound(size_t bucket)
+    {
+        if (bucket < 4) {
+            return bucket;
+        }
+        size_t exponent = bucket / 4 + 1;
+        return ((4 + bucket % 4 + 1) << (exponent - 2)) - 1;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> count_{0};
+};
+
+// PaymentExecutor: pool of worker threads for decorators that run gateway calls off the caller's thread,
+// so an attempt costs a queue push and a wakeup instead of a thread start. The pool size caps the
+// concurrent calls; further tasks queue. Decorators nest (a batch of hedged payments, a split of batched
+// ones), so a task may itself wait for tasks queued to the same pool: it does so inside a Blocking scope,
+// and the pool starts another worker whenever that would leave fewer than its size free to run the queue.
+// Added workers are kept. The destructor runs the queued tasks, then joins the workers.
+class PaymentExecutor {
+public:
+    // Marks the current thread as waiting for other payment work; a no-op off the executor's workers
+    class Blocking {
+    public:
+        Blocking() : pool_(current_)
+        {
+            if (pool_) {
+                pool_->block();
+            }
+        }
+        ~Blocking()
+        {
+            if (pool_) {
+                pool_->unblock();
+            }
+        }
+        Blocking(const Blocking &) = delete;
+        Blocking &operator=(const Blocking &) = delete;
+
+    private:
+        PaymentExecutor *pool_;
+    };
+
+    explicit PaymentExecutor(size_t workers) : size_(std::max<size_t>(workers, 1))
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (workers_.size() < size_) {
+            addWorker();
+        }
+    }
+    ~PaymentExecutor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        // Tasks still draining may block and add workers, so the list is re-read under the lock
+        for (size_t i = 0;; ++i) {
+            std::thread worker;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (i == workers_.size()) {
+                    break;
+                }
+                worker = std::move(workers_[i]);
+            }
+            worker.join();
+        }
+    }
+    PaymentExecutor(const PaymentExecutor &) = delete;
+    PaymentExecutor &operator=(const PaymentExecutor &) = delete;
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push(std::move(task));
+        }
+        cv_.notify_one();
+    }
+    // Runs call on the pool; the future carries its result or exception
+    template <typename Call>
+    auto async(Call call) -> std::future<decltype(call())>
+    {
+        auto task = std::make_shared<std::packaged_task<decltype(call())()>>(std::move(call));
+        auto result = task->get_future();
+        submit([task] { (*task)(); });
+        return result;
+    }
+
+    // Process-wide default; gateway calls mostly wait, so it has several workers per core
+    static std::shared_ptr<PaymentExecutor> shared()
+    {
+        static auto executor =
+            std::make_shared<PaymentExecutor>(std::max<size_t>(16, 4 * std::thread::hardware_concurrency()));
+        return executor;
+    }
+
+private:
+    void addWorker()
+    {
+        workers_.emplace_back([this] {
+            current_ = this;
+            run();
+        });
+    }
+    void block()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (workers_.size() - ++blocked_ < size_) {
+            addWorker();
+        }
+    }
+    void unblock()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --blocked_;
+    }
+    void run()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+        }
+    }
+
+    static inline thread_local PaymentExecutor *current_ = nullptr; // pool of the calling worker thread
+    const size_t size_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::queue<std::function<void()>> tasks_;
+    size_t blocked_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
+
+// HedgedPayment decorator: sends a backup request once the primary exceeds the observed p95 latency.
+// Both attempts run on a PaymentExecutor. A hedge repeats the charge, so the wrapped strategy must report
+// isIdempotent() (e.g. the gateway deduplicates by request id); the constructor rejects any other.
+class HedgedPayment : public PaymentStrategy {
+public:
+    HedgedPayment(std::shared_ptr<PaymentStrategy> inner, std::chrono::microseconds initial_delay,
+                  std::shared_ptr<PaymentExecutor> executor = PaymentExecutor::shared())
+        : inner_(std::move(inner)), initial_delay_(initial_delay), latency_(std::make_shared<LatencyHistogram>()),
+          executor_(std::move(executor))
+    {
+        if (!inner_->isIdempotent()) {
+            throw std::invalid_argument("hedging would charge twice: " + inner_->getName() + " is not idempotent");
+        }
+    }
+    // Returns or throws the outcome of whichever attempt finishes first
+    bool pay(double amount) const override
+    {
+        auto race = std::make_shared<Race>();
+        std::future<bool> winner = race->result.get_future();
+        PaymentExecutor::Blocking blocking;
+        launch(race, amount);
+        if (winner.wait_for(hedgeDelay()) == std::future_status::timeout) {
+            hedges_.fetch_add(1, std::memory_order_relaxed);
+            launch(race, amount);
+        }
+        return winner.get();
+    }
+    bool isIdempotent() const override { return true; }
+    std::string getName() const override { return inner_->getName() + " (hedged)"; }
+    uint64_t hedgeCount() const { return hedges_.load(std::memory_order_relaxed); }
+
+private:
+    // First finisher publishes the result; the loser's outcome is dropped
+    struct Race {
+        std::atomic<bool> done{false};
+        std::promise<bool> result;
+    };
+
+    std::chrono::microseconds hedgeDelay() const
+    {
+        return latency_->count() < kWarmupSamples ? initial_delay_ : latency_->percentile(0.95);
+    }
+    void launch(const std::shared_ptr<Race> &race, double amount) const
+    {
+        executor_->submit([inner = inner_, latency = latency_, race, amount] {
+            auto start = std::chrono::steady_clock::now();
+            try {
+                bool ok = inner->pay(amount);
+                latency->record(std::chrono::steady_clock::now() - start);
+                if (!race->done.exchange(true, std::memory_order_acq_rel)) {
+                    race->result.set_value(ok);
+                }
+            } catch (...) {
+                if (!race->done.exchange(true, std::memory_order_acq_rel)) {
+                    race->result.set_exception(std::current_exception());
+                }
+            }
+        });
+    }
+
+    static constexpr uint64_t kWarmupSamples = 20;
+    std::shared_ptr<PaymentStrategy> inner_;
+    std::chrono::microseconds initial_delay_;
+    std::shared_ptr<LatencyHistogram> latency_;
+    std::shared_ptr<PaymentExecutor> executor_;
+    mutable std::atomic<uint64_t> hedges_{0};
+};
+
+// CircuitBreakerPayment decorator: fails fast while the wrapped strategy is unhealthy
+class CircuitBreakerPayment : public PaymentStrategy {
+public:
+    enum class State : uint8_t { Closed, Open, HalfOpen };
+
+    CircuitBreakerPayment(std::shared_ptr<PaymentStrategy> inner, uint32_t failure_threshold,
+                          std::chrono::milliseconds cooldown)
+        : inner_(std::move(inner)), failure_threshold_(failure_threshold), cooldown_(cooldown)
+    {
+    }
+    bool pay(double amount) const override
+    {
+        if (!admit()) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        bool ok;
+        try {
+            ok = inner_->pay(amount);
+        } catch (...) {
+            onFailure(); // a throwing trial must reopen the breaker, not leave it half-open
+            throw;
+        }
+        ok ? onSuccess() : onFailure();
+        return ok;
+    }
+    std::string getName() const override { return inner_->getName() + " (circuit breaker)"; }
+    State state() const { return state_.load(std::memory_order_acquire); }
+    uint64_t rejectedCount() const { return rejected_.load(std::memory_order_relaxed); }
+
+private:
+    static int64_t nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+    bool admit() const
+    {
+        State current = state_.load(std::memory_order_acquire);
+        if (current == State::Closed) {
+            return true;
+        }
+        if (current == State::Open && nowNs() >= open_until_ns_.load(std::memory_order_acquire)) {
+            // Exactly one caller wins the transition and becomes the trial request
+            return state_.compare_exchange_strong(current, State::HalfOpen, std::memory_order_acq_rel);
+        }
+        return false;
+    }
+    void onSuccess() const
+    {
+        consecutive_failures_.store(0, std::memory_order_relaxed);
+        state_.store(State::Closed, std::memory_order_release);
+    }
+    void onFailure() const
+    {
+        uint32_t failures = consecutive_failures_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (failures >= failure_threshold_ || state_.load(std::memory_order_acquire) == State::HalfOpen) {
+            open_until_ns_.store(nowNs() + std::chrono::nanoseconds(cooldown_).count(), std::memory_order_release);
+            state_.store(State::Open, std::memory_order_release);
+        }
+    }
+
+    std::shared_ptr<PaymentStrategy> inner_;
+    uint32_t failure_threshold_;
+    std::chrono::milliseconds cooldown_;
+    mutable std::atomic<State> state_{State::Closed};
+    mutable std::atomic<uint32_t> consecutive_failures_{0};
+    mutable std::atomic<int64_t> open_until_ns_{0};
+    mutable std::atomic<uint64_t> rejected_{0};
+};
+
+// BatchingPayment decorator: aggregates concurrent pay() calls into payBatch() calls.
+// A batch flushes when it holds max_batch payments or its oldest payment has waited for the window.
+// The flusher thread only cuts batches; each payBatch() call runs on a PaymentExecutor, so a slow batch
+// does not hold back the batches behind it.
+class BatchingPayment : public PaymentStrategy {
+public:
+    BatchingPayment(std::shared_ptr<PaymentStrategy> inner, size_t max_batch, std::chrono::microseconds window,
+                    std::shared_ptr<PaymentExecutor> executor = PaymentExecutor::shared())
+        : inner_(std::move(inner)), max_batch_(max_batch), window_(window), executor_(std::move(executor))
+    {
+        if (max_batch_ == 0) {
+            throw std::invalid_argument("batch size must be at least 1");
+        }
+        flusher_ = std::thread([this] { flushLoop(); });
+    }
+    // Flushes what is still pending; dispatched batches complete on the executor
+    ~BatchingPayment() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_one();
+        flusher_.join();
+    }
+    bool pay(double amount) const override
+    {
+        std::promise<bool> result;
+        std::future<bool> future = result.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back({amount, std::chrono::steady_clock::now(), std::move(result)});
+            if (pending_.size() == 1 || pending_.size() >= max_batch_) {
+                cv_.notify_one();
+            }
+        }
+        PaymentExecutor::Blocking blocking;
+        return future.get();
+    }
+    std::string getName() const override { return inner_->getName() + " (batched)"; }
+    uint64_t batchCount() const { return batches_.load(std::memory_order_relaxed); }
+
+private:
+    struct Pending {
+        double amount;
+        std::chrono::steady_clock::time_point enqueued;
+        std::promise<bool> result;
+    };
+
+    void flushLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+            if (pending_.empty()) {
+                return;
+            }
+            // The deadline follows the oldest payment still queued, including leftovers of the last flush
+            cv_.wait_until(lock, pending_.front().enqueued + window_,
+                           [this] { return stopping_ || pending_.size() >= max_batch_; });
+
+            size_t count = std::min(pending_.size(), max_batch_);
+            auto batch = std::make_shared<std::vector<Pending>>(std::make_move_iterator(pending_.begin()),
+                                                                std::make_move_iterator(pending_.begin() + count));
+            pending_.erase(pending_.begin(), pending_.begin() + count);
+            lock.unlock();
+
+            batches_.fetch_add(1, std::memory_order_relaxed);
+            executor_->submit([inner = inner_, batch] { dispatch(*inner, *batch); });
+            lock.lock();
+        }
+    }
+
+    static void dispatch(const PaymentStrategy &inner, std::vector<Pending> &batch)
+    {
+        std::vector<double> amounts;
+        amounts.reserve(batch.size());
+        for (const auto &p : batch) {
+            amounts.push_back(p.amount);
+        }
+        try {
+            std::vector<bool> results = inner.payBatch(amounts);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                batch[i].result.set_value(results[i]);
+            }
+        } catch (...) {
+            for (auto &p : batch) {
+                p.result.set_exception(std::current_exception());
+            }
+        }
+    }
+
+    std::shared_ptr<PaymentStrategy> inner_;
+    size_t max_batch_;
+    std::chrono::microseconds window_;
+    std::shared_ptr<PaymentExecutor> executor_;
+    mutable std::mutex mutex_;
+    mutable std::condition_variable cv_;
+    mutable std::deque<Pending> pending_;
+    mutable std::atomic<uint64_t> batches_{0};
+    bool stopping_ = false;
+    std::thread flusher_;
+};
+
+// SplitTenderPayment composite: splits one amount across several strategies by weight and authorizes all
+// parts concurrently on a PaymentExecutor, so latency is the slowest part rather than the sum. If any part
+// fails or throws, the parts that succeeded are refunded; if a refund fails too, pay() throws instead of
+// returning a decline, because the customer has been charged for a payment that did not go through.
+class SplitTenderPayment : public PaymentStrategy {
+public:
+    struct Part {
+        std::shared_ptr<PaymentStrategy> strategy;
+        double weight;
+    };
+
+    explicit SplitTenderPayment(std::vector<Part> parts,
+                                std::shared_ptr<PaymentExecutor> executor = PaymentExecutor::shared())
+        : parts_(std::move(parts)), executor_(std::move(executor))
+    {
+        double total_weight = 0.0;
+        for (const auto &p : parts_) {
+            if (!std::isfinite(p.weight) || p.weight < 0.0) {
+                throw std::invalid_argument("split tender weights must be finite and non-negative");
+            }
+            total_weight += p.weight;
+        }
+        if (!(total_weight > 0.0) || !std::isfinite(total_weight)) {
+            throw std::invalid_argument("split tender weights must have a positive sum");
+        }
+    }
+
+    bool pay(double amount) const override
+    {
+        if (!std::isfinite(amount) || amount <= 0.0) {
+            return false;
+        }
+        std::vector<int64_t> cents = split(std::llround(amount * 100.0));
+        std::vector<std::future<bool>> results(parts_.size());
+        PaymentExecutor::Blocking blocking;
+        for (size_t i = 0; i < parts_.size(); ++i) {
+            if (cents[i] > 0) { // a part with nothing to charge is not sent to its strategy
+                results[i] = executor_->async([this, i, &cents] {
+                    return parts_[i].strategy->pay(static_cast<double>(cents[i]) / 100.0);
+                });
+            }
+        }
+        // Every part is awaited, even after one throws, so none outlives `cents`
+        std::vector<bool> charged(parts_.size(), false);
+        bool all_ok = true;
+        std::exception_ptr error;
+        for (size_t i = 0; i < parts_.size(); ++i) {
+            if (!results[i].valid()) {
+                continue;
+            }
+            try {
+                charged[i] = results[i].get();
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            all_ok = all_ok && charged[i];
+        }
+        if (all_ok) {
+            return true;
+        }
+
+        std::vector<std::pair<size_t, std::future<bool>>> refunds;
+        for (size_t i = 0; i < parts_.size(); ++i) {
+            if (charged[i]) {
+                refunds.emplace_back(i, executor_->async([this, i, &cents] {
+                    return parts_[i].strategy->refund(static_cast<double>(cents[i]) / 100.0);
+                }));
+            }
+        }
+        int64_t unrefunded_cents = 0;
+        for (auto &[i, refund] : refunds) {
+            bool refunded = false;
+            try {
+                refunded = refund.get();
+            } catch (...) {
+            }
+            if (refunded) {
+                rollbacks_.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                unrefunded_cents += cents[i];
+            }
+        }
+        if (unrefunded_cents > 0) {
+            rollback_failures_.fetch_add(1, std::memory_order_relaxed);
+            char message[96];
+            std::snprintf(message, sizeof(message), "split tender rollback failed: $%.2f charged but not refunded",
+                          static_cast<double>(unrefunded_cents) / 100.0);
+            throw std::runtime_error(message);
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return false;
+    }
+    std::string getName() const override
+    {
+        std::string name = "Split (";
+        for (size_t i = 0; i < parts_.size(); ++i) {
+            name += (i ? " + " : "") + parts_[i].strategy->getName();
+        }
+        return name + ")";
+    }
+    // Parts successfully refunded after a failed split, and splits whose rollback failed
+    uint64_t rollbackCount() const { return rollbacks_.load(std::memory_order_relaxed); }
+    uint64_t rollbackFailureCount() const { return rollback_failures_.load(std::memory_order_relaxed); }
+
+private:
+    // Largest-remainder allocation in whole cents: every part gets the floor of its exact share, and the
+    // cents left over go to the parts with the largest fractional remainders, so parts sum to the total
+    // and none is negative or more than a cent away from its exact share.
+    std::vector<int64_t> split(int64_t total_cents) const
+    {
+        double total_weight = 0.0;
+        for (const auto &p : parts_) {
+            total_weight += p.weight;
+        }
+        std::vector<int64_t> cents(parts_.size());
+        std::vector<std::pair<double, size_t>> remainders;
+        int64_t assigned = 0;
+        for (size_t i = 0; i < parts_.size(); ++i) {
+            double share = static_cast<double>(total_cents) * (parts_[i].weight / total_weight);
+            cents[i] = std::min(static_cast<int64_t>(std::floor(share)), total_cents - assigned);
+            assigned += cents[i];
+            remainders.emplace_back(share - static_cast<double>(cents[i]), i);
+        }
+        std::sort(remainders.begin(), remainders.end(), [](const auto &a, const auto &b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        for (size_t k = 0; assigned < total_cents; k = (k + 1) % remainders.size()) {
+            if (parts_[remainders[k].second].weight > 0.0) {
+                ++cents[remainders[k].second];
+                ++assigned;
+            }
+        }
+        return cents;
+    }
+
+    std::vector<Part> parts_;
+    std::shared_ptr<PaymentExecutor> executor_;
+    mutable std::atomic<uint64_t> rollbacks_{0}, rollback_failures_{0};
+};
+
+// CycleClock: timestamps for per-payment latency. On x86-64 it reads the invariant TSC, which costs less
+// than steady_clock::now(); ticks are converted with a ratio calibrated once against steady_clock.
+// Elsewhere it falls back to steady_clock.
+class CycleClock {
+public:
+    static uint64_t now()
+    {
+#if defined(__x86_64__)
+        return __builtin_ia32_rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+    static std::chrono::nanoseconds since(uint64_t start)
+    {
+        return std::chrono::nanoseconds(static_cast<int64_t>(static_cast<double>(now() - start) * nsPerTick()));
+    }
+    static double nsPerTick()
+    {
+        static const double ratio = calibrate();
+        return ratio;
+    }
+
+private:
+    static double calibrate()
+    {
+#if defined(__x86_64__)
+        auto wall_start = std::chrono::steady_clock::now();
+        uint64_t ticks_start = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        auto wall = std::chrono::steady_clock::now() - wall_start;
+        uint64_t ticks = now() - ticks_start;
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count()) /
+               static_cast<double>(std::max<uint64_t>(ticks, 1));
+#else
+        return 1e9 * std::chrono::steady_clock::period::num / std::chrono::steady_clock::period::den;
+#endif
+    }
+};
+
+// Writes s as a JSON string literal, escaping quotes, backslashes and control characters
+void writeJsonString(std::ostream &out, std::string_view s)
+{
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// PaymentMetrics: per-strategy counters and latency histograms.
+// Each thread writes its own shard with plain relaxed stores (no RMW, no sharing);
+// snapshot() merges all shards. Counters see every payment. The two clock reads would cost more than
+// the rest of the instrumentation, so recordPayment() times a strategy 1 payment in kSampleEvery, and
+// times every payment once a sample shows it takes at least kAlwaysTimeAbove.
+class PaymentMetrics {
+public:
+    static constexpr size_t kMaxStrategies = 16;
+    static constexpr uint32_t kSampleEvery = 16;
+    static constexpr std::chrono::nanoseconds kAlwaysTimeAbove{2000};
+    static constexpr size_t kThreadCache = 64;
+
+    struct StrategyStats {
+        std::string name;
+        uint64_t attempts = 0, successes = 0, failures = 0;
+        double amount_total = 0.0;
+        std::array<uint64_t, LatencyHistogram::kBuckets> latency_us{};
+    };
+
+    PaymentMetrics() : id_(next_id_.fetch_add(1, std::memory_order_relaxed))
+    {
+        CycleClock::nsPerTick(); // calibrate now rather than inside the first timed payment
+    }
+    PaymentMetrics(const PaymentMetrics &) = delete;
+    PaymentMetrics &operator=(const PaymentMetrics &) = delete;
+
+    // Resolves a strategy name to its slot; called once per setPaymentStrategy, not per payment.
+    // Throws std::length_error for a strategy beyond kMaxStrategies rather than merging it into another's slot.
+    size_t slotFor(const std::string &name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find(names_.begin(), names_.end(), name);
+        if (it != names_.end()) {
+            return static_cast<size_t>(it - names_.begin());
+        }
+        if (names_.size() == kMaxStrategies) {
+            throw std::length_error("PaymentMetrics tracks at most " + std::to_string(kMaxStrategies) +
+                                    " strategies; cannot add " + name);
+        }
+        names_.push_back(name);
+        return names_.size() - 1;
+    }
+
+    void record(size_t slot, bool ok, double amount, std::chrono::nanoseconds latency) const
+    {
+        Counters &c = localShard().slots[slot];
+        count(c, ok, amount);
+        recordLatency(c, latency);
+    }
+
+    // Runs pay() and records its outcome, timing it as described above; returns pay()'s result
+    template <typename Pay>
+    bool recordPayment(size_t slot, double amount, Pay pay) const
+    {
+        Shard &shard = localShard();
+        Counters &c = shard.slots[slot];
+        Sampler &sampler = shard.samplers[slot];
+        if (!sampler.slow && ++sampler.untimed < kSampleEvery) {
+            bool ok = pay();
+            count(c, ok, amount);
+            return ok;
+        }
+        sampler.untimed = 0;
+        uint64_t start = CycleClock::now();
+        bool ok = pay();
+        std::chrono::nanoseconds latency = CycleClock::since(start);
+        sampler.slow = latency >= kAlwaysTimeAbove;
+        count(c, ok, amount);
+        recordLatency(c, latency);
+        return ok;
+    }
+
+    std::vector<StrategyStats> snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<StrategyStats> stats(names_.size());
+        for (size_t i = 0; i < names_.size(); ++i) {
+            stats[i].name = names_[i];
+            for (const auto &[thread, shard] : shards_) {
+                const Counters &c = shard->slots[i];
+                stats[i].attempts += c.attempts.load(std::memory_order_relaxed);
+                stats[i].successes += c.successes.load(std::memory_order_relaxed);
+                stats[i].failures += c.failures.load(std::memory_order_relaxed);
+                stats[i].amount_total += c.amount_total.load(std::memory_order_relaxed);
+                for (size_t b = 0; b < LatencyHistogram::kBuckets; ++b) {
+                    stats[i].latency_us[b] += c.latency_us[b].load(std::memory_order_relaxed);
+                }
+            }
+        }
+        return stats;
+    }
+
+    void dumpText(std::ostream &out) const
+    {
+        for (const auto &s : snapshot()) {
+            out << "   " << s.name << ": attempts=" << s.attempts << " successes=" << s.successes
+                << " failures=" << s.failures << " amount=$" << std::fixed << std::setprecision(2) << s.amount_total
+                << " p50=" << LatencyHistogram::percentileOf(s.latency_us, 0.50).count()
+                << "us p99=" << LatencyHistogram::percentileOf(s.latency_us, 0.99).count() << "us" << std::endl;
+        }
+    }
+
+    void dumpJson(std::ostream &out) const
+    {
+        auto stats = snapshot();
+        out << "{\"strategies\":[";
+        for (size_t i = 0; i < stats.size(); ++i) {
+            const auto &s = stats[i];
+            out << (i ? "," : "") << "{\"name\":";
+            writeJsonString(out, s.name);
+            out << ",\"attempts\":" << s.attempts
+                << ",\"successes\":" << s.successes << ",\"failures\":" << s.failures << ",\"amount_total\":"
+                << std::fixed << std::setprecision(2) << s.amount_total
+                << ",\"latency_us\":{\"p50\":" << LatencyHistogram::percentileOf(s.latency_us, 0.50).count()
+                << ",\"p99\":" << LatencyHistogram::percentileOf(s.latency_us, 0.99).count()
+                << ",\"p999\":" << LatencyHistogram::percentileOf(s.latency_us, 0.999).count() << "}}";
+        }
+        out << "]}";
+    }
+
+private:
+    struct Counters {
+        std::atomic<uint64_t> attempts{0}, successes{0}, failures{0};
+        std::atomic<double> amount_total{0.0};
+        std::array<std::atomic<uint64_t>, LatencyHistogram::kBuckets> latency_us{};
+    };
+    // Owned by the shard's thread and never read by snapshot()
+    struct Sampler {
+        uint32_t untimed = kSampleEvery - 1; // the first payment is always timed
+        bool slow = false;
+    };
+    struct Shard {
+        std::array<Counters, kMaxStrategies> slots;
+        std::array<Sampler, kMaxStrategies> samplers;
+    };
+
+    static void count(Counters &c, bool ok, double amount)
+    {
+        bump(c.attempts);
+        bump(ok ? c.successes : c.failures);
+        if (ok) {
+            c.amount_total.store(c.amount_total.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+    }
+    static void recordLatency(Counters &c, std::chrono::nanoseconds latency)
+    {
+        auto us = static_cast<uint64_t>(std::max<int64_t>(latency.count() / 1000, 0));
+        bump(c.latency_us[LatencyHistogram::bucketFor(us)]);
+    }
+
+    // Single writer per shard, so a load + store is enough and avoids a locked instruction
+    static void bump(std::atomic<uint64_t> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // Direct-mapped per-thread cache keyed by instance id. Ids are never reused, so an entry left behind by
+    // a destroyed PaymentMetrics never matches a live one, and the cache does not grow with the number of
+    // instances a thread has used. A miss finds (or creates) this thread's shard under the lock.
+    Shard &localShard() const
+    {
+        thread_local std::array<std::pair<uint64_t, Shard *>, kThreadCache> cache{};
+        auto &entry = cache[id_ % kThreadCache];
+        if (entry.first == id_) {
+            return *entry.second;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::unique_ptr<Shard> &shard = shards_[std::this_thread::get_id()];
+        if (!shard) {
+            shard = std::make_unique<Shard>();
+        }
+        entry = {id_, shard.get()};
+        return *shard;
+    }
+
+    static inline std::atomic<uint64_t> next_id_{1};
+    const uint64_t id_;
+    mutable std::mutex mutex_;
+    std::vector<std::string> names_;
+    // One per recording thread; a thread id reused by a later thread takes over the finished thread's shard
+    mutable std::unordered_map<std::thread::id, std::unique_ptr<Shard>> shards_;
+};
+
+// LedgerRecord: fixed-size payment record as laid out in a ledger segment file
+struct LedgerRecord {
+    uint64_t transaction_id;
+    int64_t timestamp_ns; // system_clock, nanoseconds since epoch
+    uint64_t account;
+    double amount;
+    char strategy[24];
+    uint32_t committed; // 0, or the committing open's epoch; written last (release) so scanners never see a torn record
+    uint32_t reserved;
+};
+static_assert(sizeof(LedgerRecord) == 64, "LedgerRecord must stay one cache line");
+
+// PaymentLedger: append-only ledger of LedgerRecords in memory-mapped segment files.
+// append() reserves a slot with one fetch_add; only the first writer into a new segment takes a lock
+// to create its file. Every kIndexStride-th record's timestamp goes into a sparse in-memory index.
+// A ledger must be reopened with the records-per-segment it was created with; the constructor throws
+// otherwise.
+class PaymentLedger {
+public:
+    static constexpr size_t kMaxSegments = 1024;
+    static constexpr uint64_t kIndexStride = 1024;
+
+    PaymentLedger(std::filesystem::path directory, uint64_t records_per_segment)
+        : directory_(std::move(directory)), records_per_segment_(records_per_segment)
+    {
+        std::filesystem::create_directories(directory_);
+        recover();
+    }
+    ~PaymentLedger()
+    {
+        for (auto &slot : segments_) {
+            delete slot.load(std::memory_order_acquire);
+        }
+    }
+    PaymentLedger(const PaymentLedger &) = delete;
+    PaymentLedger &operator=(const PaymentLedger &) = delete;
+
+    uint64_t append(uint64_t account, double amount, const std::string &strategy)
+    {
+        uint64_t sequence = next_.fetch_add(1, std::memory_order_relaxed);
+        Segment &segment = segmentFor(sequence);
+        uint64_t offset = sequence % records_per_segment_;
+        LedgerRecord &record = segment.records[offset];
+        // Retract the slot before rewriting it so a reader never pairs a committed flag with a partial payload
+        __atomic_store_n(&record.committed, 0, __ATOMIC_RELAXED);
+        std::atomic_thread_fence(std::memory_order_release);
+        record.transaction_id = sequence;
+        record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::system_clock::now().time_since_epoch())
+                                  .count();
+        record.account = account;
+        record.amount = amount;
+        std::memset(record.strategy, 0, sizeof(record.strategy));
+        std::memcpy(record.strategy, strategy.data(), std::min(strategy.size(), sizeof(record.strategy) - 1));
+        if (offset % kIndexStride == 0) {
+            segment.index[offset / kIndexStride].store(record.timestamp_ns, std::memory_order_relaxed);
+        }
+        __atomic_store_n(&record.committed, epoch_, __ATOMIC_RELEASE);
+        return sequence;
+    }
+
+    // Visits committed records from `from` in order, stopping at the first not yet committed
+    template <typename Visitor>
+    uint64_t scan(uint64_t from, Visitor visit) const
+    {
+        return scanRange(from, UINT64_MAX, visit);
+    }
+
+    // Like scan(), but stops before sequence `to`; disjoint ranges can be scanned in parallel
+    template <typename Visitor>
+    uint64_t scanRange(uint64_t from, uint64_t to, Visitor visit) const
+    {
+        uint64_t end = std::min(to, next_.load(std::memory_order_acquire));
+        uint64_t sequence = from;
+        for (; sequence < end; ++sequence) {
+            const Segment *segment = segments_[sequence / records_per_segment_].load(std::memory_order_acquire);
+            if (!segment) {
+                break;
+            }
+            const LedgerRecord &record = segment->records[sequence % records_per_segment_];
+            if (!committed(sequence, __atomic_load_n(&record.committed, __ATOMIC_ACQUIRE))) {
+                break;
+            }
+            visit(record);
+        }
+        return sequence - from;
+    }
+
+    // Visits records appended at or after timestamp_ns. Concurrent appenders may commit slightly out of
+    // timestamp order, so the scan starts one index stride early and filters.
+    template <typename Visitor>
+    uint64_t scanSince(int64_t timestamp_ns, Visitor visit) const
+    {
+        uint64_t start = findIndexed(timestamp_ns);
+        return scan(start, [&](const LedgerRecord &record) {
+            if (record.timestamp_ns >= timestamp_ns) {
+                visit(record);
+            }
+        });
+    }
+
+    uint64_t size() const { return next_.load(std::memory_order_acquire); }
+
+private:
+    // A new (or empty) segment file is sized for `capacity` records. An existing one is never resized: a
+    // file of any other size was written with a different records-per-segment and is refused.
+    struct Segment {
+        Segment(const std::filesystem::path &path, uint64_t capacity) : bytes(capacity * sizeof(LedgerRecord))
+        {
+            int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            struct stat st;
+            if (fd < 0 || ::fstat(fd, &st) != 0 ||
+                (st.st_size == 0 && ::ftruncate(fd, static_cast<off_t>(bytes)) != 0)) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                throw std::runtime_error("cannot create ledger segment " + path.string());
+            }
+            if (st.st_size != 0 && static_cast<uint64_t>(st.st_size) != bytes) {
+                ::close(fd);
+                throw std::runtime_error("ledger segment " + path.string() + " holds " +
+                                         std::to_string(st.st_size / sizeof(LedgerRecord)) + " records, expected " +
+                                         std::to_string(capacity));
+            }
+            void *mapped = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (mapped == MAP_FAILED) {
+                throw std::runtime_error("cannot map ledger segment " + path.string());
+            }
+            records = static_cast<LedgerRecord *>(mapped);
+            index = std::make_unique<std::atomic<int64_t>[]>(capacity / kIndexStride + 1);
+        }
+        ~Segment() { ::munmap(records, bytes); }
+
+        size_t bytes;
+        LedgerRecord *records;
+        std::unique_ptr<std::atomic<int64_t>[]> index;
+    };
+
+    // Last indexed sequence whose timestamp is before timestamp_ns. The index restarts in every segment
+    // (entry k covers offset k * kIndexStride), so it is walked segment by segment.
+    uint64_t findIndexed(int64_t timestamp_ns) const
+    {
+        uint64_t start = 0;
+        uint64_t end = next_.load(std::memory_order_acquire);
+        for (size_t number = 0; number < kMaxSegments && number * records_per_segment_ < end; ++number) {
+            const Segment *segment = segments_[number].load(std::memory_order_acquire);
+            if (!segment) {
+                break;
+            }
+            for (uint64_t offset = 0; offset < records_per_segment_; offset += kIndexStride) {
+                uint64_t sequence = number * records_per_segment_ + offset;
+                int64_t indexed = sequence < end ? segment->index[offset / kIndexStride].load(std::memory_order_relaxed)
+                                                 : 0;
+                if (indexed == 0 || indexed >= timestamp_ns) {
+                    return start;
+                }
+                start = sequence;
+            }
+        }
+        return start;
+    }
+
+    std::filesystem::path segmentPath(size_t number) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "ledger-%06zu.seg", number);
+        return directory_ / name;
+    }
+
+    Segment &segmentFor(uint64_t sequence)
+    {
+        size_t number = sequence / records_per_segment_;
+        if (number >= kMaxSegments) {
+            throw std::length_error("payment ledger is full");
+        }
+        Segment *segment = segments_[number].load(std::memory_order_acquire);
+        if (!segment) {
+            std::lock_guard<std::mutex> lock(create_mutex_);
+            segment = segments_[number].load(std::memory_order_acquire);
+            if (!segment) {
+                segment = new Segment(segmentPath(number), records_per_segment_);
+                segments_[number].store(segment, std::memory_order_release);
+            }
+        }
+        return *segment;
+    }
+
+    // Records up to the recovered tail were committed by earlier opens; past it, only records committed
+    // under this open's epoch count, so leftovers behind a hole never reappear once their slot is reused
+    bool committed(uint64_t sequence, uint32_t epoch) const
+    {
+        return epoch != 0 && (sequence < recovered_ || epoch == epoch_);
+    }
+
+    // Maps existing segments and continues after the committed prefix. Each open appends after the prefix
+    // it found, under a newer epoch, so epochs never decrease along the prefix: it ends at the first slot
+    // that is uncommitted or holds an older epoch than the slot before it (a leftover behind an earlier
+    // hole). Records past the end stay on disk untouched; this open commits under a newer epoch than any
+    // of them, so scans ignore them until appends overwrite their slots.
+    void recover()
+    {
+        uint64_t sequence = 0;
+        uint32_t newest = 0, previous = 0;
+        bool hole = false;
+        for (size_t number = 0; number < kMaxSegments && std::filesystem::exists(segmentPath(number)); ++number) {
+            Segment &segment = segmentFor(number * records_per_segment_);
+            for (uint64_t offset = 0; offset < records_per_segment_; ++offset) {
+                const LedgerRecord &record = segment.records[offset];
+                newest = std::max(newest, record.committed);
+                hole = hole || record.committed == 0 || record.committed < previous;
+                if (hole) {
+                    continue;
+                }
+                previous = record.committed;
+                if (offset % kIndexStride == 0) {
+                    segment.index[offset / kIndexStride].store(record.timestamp_ns);
+                }
+                ++sequence;
+            }
+        }
+        if (newest == UINT32_MAX) {
+            throw std::runtime_error("payment ledger " + directory_.string() + " has no epochs left");
+        }
+        epoch_ = newest + 1;
+        recovered_ = sequence;
+        next_.store(sequence, std::memory_order_release);
+    }
+
+    std::filesystem::path directory_;
+    uint64_t records_per_segment_;
+    uint32_t epoch_ = 1;     // stored in committed by this open's appends
+    uint64_t recovered_ = 0; // committed prefix found by recover()
+    std::atomic<uint64_t> next_{0};
+    std::array<std::atomic<Segment *>, kMaxSegments> segments_{};
+    std::mutex create_mutex_;
+};
+
+// LedgerReconciler: matches ledger records against a gateway settlement file
+// ("transaction_id,amount" per line) with a partitioned (Grace) hash join. Both inputs are streamed
+// in parallel into per-partition spill files; each partition is then joined by one worker, so memory
+// holds one partition's hash table per thread rather than either input. Each run spills into its own
+// fresh subdirectory of spill_dir and removes only that; any spill I/O error fails the run.
+class LedgerReconciler {
+public:
+    struct Discrepancy {
+        enum Kind : uint8_t { AmountMismatch, MissingInSettlement, MissingInLedger } kind;
+        uint64_t transaction_id;
+        double ledger_amount, settled_amount;
+    };
+    struct Report {
+        uint64_t matched = 0, amount_mismatches = 0, missing_in_settlement = 0, missing_in_ledger = 0;
+        uint64_t malformed_lines = 0; // settlement lines that are not "transaction_id,amount"; not matched
+        std::vector<Discrepancy> samples; // first few discrepancies, for inspection
+    };
+
+    LedgerReconciler(std::filesystem::path spill_dir, size_t partitions, size_t threads)
+        : spill_dir_(std::move(spill_dir)), partitions_(partitions), threads_(std::max<size_t>(threads, 1))
+    {
+        if (partitions_ == 0) {
+            throw std::invalid_argument("reconciler needs at least one partition");
+        }
+    }
+
+    // Throws std::runtime_error if an input cannot be read or a spill file cannot be written
+    Report reconcile(const PaymentLedger &ledger, const std::filesystem::path &settlement)
+    {
+        std::filesystem::create_directories(spill_dir_);
+        std::string work_dir = (spill_dir_ / "reconcile-XXXXXX").string();
+        if (!::mkdtemp(work_dir.data())) {
+            throw std::runtime_error("cannot create spill directory in " + spill_dir_.string());
+        }
+        struct RemoveOnExit {
+            std::filesystem::path dir;
+            ~RemoveOnExit()
+            {
+                std::error_code ignored;
+                std::filesystem::remove_all(dir, ignored);
+            }
+        } cleanup{work_dir};
+        SpillSet ledger_spill(cleanup.dir, "ledger", partitions_);
+        SpillSet settlement_spill(cleanup.dir, "settlement", partitions_);
+        partitionLedger(ledger, ledger_spill);
+        Report report;
+        report.malformed_lines = partitionSettlement(settlement, settlement_spill);
+        ledger_spill.close();
+        settlement_spill.close();
+
+        std::mutex report_mutex;
+        std::atomic<size_t> next_partition{0};
+        parallel([&](size_t) {
+            Report local;
+            for (size_t p; (p = next_partition.fetch_add(1)) < partitions_;) {
+                joinPartition(ledger_spill.path(p), settlement_spill.path(p), local);
+            }
+            std::lock_guard<std::mutex> lock(report_mutex);
+            report.matched += local.matched;
+            report.amount_mismatches += local.amount_mismatches;
+            report.missing_in_settlement += local.missing_in_settlement;
+            report.missing_in_ledger += local.missing_in_ledger;
+            for (const auto &d : local.samples) {
+                if (report.samples.size() < kMaxSamples) {
+                    report.samples.push_back(d);
+                }
+            }
+        });
+        return report;
+    }
+
+private:
+    static constexpr size_t kMaxSamples = 8;
+    static constexpr size_t kSpillBuffer = 4096;
+
+    struct Entry {
+        uint64_t transaction_id;
+        double amount;
+    };
+
+    // One append-only spill file per partition, shared by all partitioning threads
+    class SpillSet {
+    public:
+        SpillSet(const std::filesystem::path &dir, const std::string &prefix, size_t partitions)
+            : files_(partitions), mutexes_(partitions)
+        {
+            for (size_t p = 0; p < partitions; ++p) {
+                paths_.push_back(dir / (prefix + "-" + std::to_string(p) + ".bin"));
+                files_[p] = std::fopen(paths_[p].c_str(), "wb");
+                if (!files_[p]) {
+                    throw std::runtime_error("cannot create spill file " + paths_[p].string());
+                }
+            }
+        }
+        ~SpillSet()
+        {
+            for (std::FILE *f : files_) {
+                if (f) {
+                    std::fclose(f);
+                }
+            }
+        }
+        void write(size_t partition, const std::vector<Entry> &entries)
+        {
+            std::lock_guard<std::mutex> lock(mutexes_[partition]);
+            if (std::fwrite(entries.data(), sizeof(Entry), entries.size(), files_[partition]) != entries.size()) {
+                throw std::runtime_error("cannot write spill file " + paths_[partition].string());
+            }
+        }
+        // Flushes and closes every file; a failure here means buffered entries were lost
+        void close()
+        {
+            bool ok = true;
+            for (auto &f : files_) {
+                if (f) {
+                    ok = std::fclose(f) == 0 && ok;
+                    f = nullptr;
+                }
+            }
+            if (!ok) {
+                throw std::runtime_error("cannot write spill files in " + paths_.front().parent_path().string());
+            }
+        }
+        const std::filesystem::path &path(size_t partition) const { return paths_[partition]; }
+
+    private:
+        std::vector<std::filesystem::path> paths_;
+        std::vector<std::FILE *> files_;
+        std::vector<std::mutex> mutexes_;
+    };
+
+    // Per-thread buffers so spill files are written in large blocks; flush() writes the remainder
+    class Partitioner {
+    public:
+        Partitioner(SpillSet &spill, size_t partitions) : spill_(spill), buffers_(partitions) {}
+        void flush()
+        {
+            for (size_t p = 0; p < buffers_.size(); ++p) {
+                spill_.write(p, buffers_[p]);
+                buffers_[p].clear();
+            }
+        }
+        void add(uint64_t transaction_id, double amount)
+        {
+            size_t p = partitionOf(transaction_id, buffers_.size());
+            buffers_[p].push_back({transaction_id, amount});
+            if (buffers_[p].size() == kSpillBuffer) {
+                spill_.write(p, buffers_[p]);
+                buffers_[p].clear();
+            }
+        }
+
+    private:
+        SpillSet &spill_;
+        std::vector<std::vector<Entry>> buffers_;
+    };
+
+    static size_t partitionOf(uint64_t transaction_id, size_t partitions)
+    {
+        return static_cast<size_t>((transaction_id * 0x9e3779b97f4a7c15ULL) >> 32) % partitions;
+    }
+    static int64_t cents(double amount) { return std::llround(amount * 100.0); }
+
+    // Runs task(t) on threads_ threads and rethrows the first exception once all have finished
+    template <typename Task>
+    void parallel(Task task) const
+    {
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads_; ++t) {
+            workers.emplace_back([&, t] {
+                try {
+                    task(t);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            });
+        }
+        for (auto &w : workers) {
+            w.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void partitionLedger(const PaymentLedger &ledger, SpillSet &spill) const
+    {
+        uint64_t total = ledger.size();
+        parallel([&](size_t t) {
+            Partitioner partitioner(spill, partitions_);
+            ledger.scanRange(total * t / threads_, total * (t + 1) / threads_, [&](const LedgerRecord &record) {
+                partitioner.add(record.transaction_id, record.amount);
+            });
+            partitioner.flush();
+        });
+    }
+
+    // Each thread parses a byte range, starting at the first line that begins inside it. Lines may be of
+    // any length; blank lines are skipped, and any other line that does not parse as a whole is counted
+    // and returned rather than dropped unnoticed.
+    uint64_t partitionSettlement(const std::filesystem::path &settlement, SpillSet &spill) const
+    {
+        auto size = static_cast<long>(std::filesystem::file_size(settlement));
+        std::atomic<uint64_t> malformed{0};
+        parallel([&](size_t t) {
+            long begin = size * static_cast<long>(t) / static_cast<long>(threads_);
+            long end = size * static_cast<long>(t + 1) / static_cast<long>(threads_);
+            std::unique_ptr<std::FILE, int (*)(std::FILE *)> in(std::fopen(settlement.c_str(), "rb"), &std::fclose);
+            if (!in) {
+                throw std::runtime_error("cannot read settlement file " + settlement.string());
+            }
+            Partitioner partitioner(spill, partitions_);
+            char *line = nullptr;
+            size_t capacity = 0;
+            auto next_line = [&] { return ::getline(&line, &capacity, in.get()); };
+            std::unique_ptr<char *, void (*)(char **)> buffer(&line, [](char **p) { std::free(*p); });
+            std::fseek(in.get(), std::max(begin - 1, 0L), SEEK_SET);
+            if (begin > 0) {
+                next_line(); // finish the line owned by the previous range
+            }
+            uint64_t local_malformed = 0;
+            for (ssize_t length; std::ftell(in.get()) < end && (length = next_line()) >= 0;) {
+                while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+                    line[--length] = '\0';
+                }
+                Entry entry;
+                if (parseSettlementLine(line, static_cast<size_t>(length), entry)) {
+                    partitioner.add(entry.transaction_id, entry.amount);
+                } else if (length > 0) {
+                    ++local_malformed;
+                }
+            }
+            if (std::ferror(in.get())) {
+                throw std::runtime_error("cannot read settlement file " + settlement.string());
+            }
+            partitioner.flush();
+            malformed.fetch_add(local_malformed, std::memory_order_relaxed);
+        });
+        return malformed.load();
+    }
+
+    // "transaction_id,amount" with a decimal id and a finite amount, nothing else on the line
+    static bool parseSettlementLine(const char *line, size_t length, Entry &entry)
+    {
+        if (length == 0 || line[0] < '0' || line[0] > '9') {
+            return false;
+        }
+        char *cursor;
+        errno = 0;
+        entry.transaction_id = std::strtoull(line, &cursor, 10);
+        if (errno == ERANGE || *cursor != ',') {
+            return false;
+        }
+        const char *amount = cursor + 1;
+        entry.amount = std::strtod(amount, &cursor);
+        return cursor != amount && cursor == line + length && std::isfinite(entry.amount);
+    }
+
+    static std::vector<Entry> readSpill(const std::filesystem::path &path)
+    {
+        std::vector<Entry> entries(std::filesystem::file_size(path) / sizeof(Entry));
+        std::FILE *in = std::fopen(path.c_str(), "rb");
+        bool ok = in && std::fread(entries.data(), sizeof(Entry), entries.size(), in) == entries.size();
+        if (in) {
+            std::fclose(in);
+        }
+        if (!ok) {
+            throw std::runtime_error("cannot read spill file " + path.string());
+        }
+        return entries;
+    }
+
+    static void joinPartition(const std::filesystem::path &ledger_part, const std::filesystem::path &settlement_part,
+                              Report &report)
+    {
+        auto note = [&](Discrepancy d) {
+            if (report.samples.size() < kMaxSamples) {
+                report.samples.push_back(d);
+            }
+        };
+        std::unordered_map<uint64_t, double> build;
+        std::vector<Entry> ledger_entries = readSpill(ledger_part);
+        build.reserve(ledger_entries.size());
+        for (const Entry &e : ledger_entries) {
+            build.emplace(e.transaction_id, e.amount);
+        }
+        for (const Entry &e : readSpill(settlement_part)) {
+            auto it = build.find(e.transaction_id);
+            if (it == build.end()) {
+                ++report.missing_in_ledger;
+                note({Discrepancy::MissingInLedger, e.transaction_id, 0.0, e.amount});
+                continue;
+            }
+            if (cents(it->second) == cents(e.amount)) {
+                ++report.matched;
+            } else {
+                ++report.amount_mismatches;
+                note({Discrepancy::AmountMismatch, e.transaction_id, it->second, e.amount});
+            }
+            build.erase(it);
+        }
+        for (const auto &[transaction_id, amount] : build) {
+            ++report.missing_in_settlement;
+            note({Discrepancy::MissingInSettlement, transaction_id, amount, 0.0});
+        }
+    }
+
+    std::filesystem::path spill_dir_;
+    size_t partitions_;
+    size_t threads_;
+};
+
+// PaymentRequest: one payment as seen by batch processing; region 0 means unknown
+struct PaymentRequest {
+    uint64_t account;
+    double amount;
+    uint16_t region;
+};
+
+// FraudScreen: linear risk score from per-account rolling features kept in columnar arrays
+// (decayed velocity, amount mean/variance, home region). A batch is gathered into contiguous
+// scratch arrays and scored by a branch-free loop the compiler vectorizes; features are updated
+// afterwards, so payments within one batch are scored against the state before the batch.
+// screenOne() scores a single request straight from its feature row, without scratch or allocation.
+// Account ids below the table size index their own row; larger ids (e.g. PayPal account hashes) are
+// hashed onto a row and may share it. Calls are serialized by a mutex, so one screen can serve the
+// concurrent processPayment() calls of a context; give each shard its own screen to avoid contention.
+class FraudScreen {
+public:
+    static constexpr size_t kBatch = 256;
+
+    struct Weights {
+        float bias = -3.0f, velocity = 0.4f, amount_z2 = 0.15f, geo_mismatch = 3.5f;
+        float threshold = 1.0f;
+    };
+
+    FraudScreen(size_t accounts, Weights weights)
+        : weights_(weights), velocity_(std::max<size_t>(accounts, 1), 0.0f), last_seen_(velocity_.size(), 0.0f),
+          mean_(velocity_.size(), 0.0f), variance_(velocity_.size(), 100.0f), home_region_(velocity_.size(), 0),
+          origin_(std::chrono::steady_clock::now())
+    {
+    }
+
+    void setHomeRegion(uint64_t account, uint16_t region)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        home_region_[rowOf(account)] = region;
+    }
+
+    // Sets allowed[i] to 0 for requests scoring above the threshold
+    void screen(const std::vector<PaymentRequest> &requests, std::vector<uint8_t> &allowed)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        float now = std::chrono::duration<float>(std::chrono::steady_clock::now() - origin_).count();
+        for (size_t begin = 0; begin < requests.size(); begin += kBatch) {
+            size_t n = std::min(kBatch, requests.size() - begin);
+            gather(&requests[begin], n);
+            score(now);
+            for (size_t i = 0; i < n; ++i) {
+                allowed[begin + i] = allowed[begin + i] && scores_[i] <= weights_.threshold;
+            }
+            update(n, now);
+        }
+    }
+
+    // Single-request path of screen(): true if the request is allowed
+    bool screenOne(const PaymentRequest &request)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        float now = std::chrono::duration<float>(std::chrono::steady_clock::now() - origin_).count();
+        size_t row = rowOf(request.account);
+        auto amount = static_cast<float>(request.amount);
+        float velocity = 0.0f;
+        float score = riskScore(weights_, now, velocity_[row], last_seen_[row], mean_[row], variance_[row], amount,
+                                request.region, home_region_[row], velocity);
+        updateRow(row, amount, velocity, now);
+        return score <= weights_.threshold;
+    }
+
+private:
+    size_t rowOf(uint64_t account) const
+    {
+        if (account < velocity_.size()) {
+            return static_cast<size_t>(account);
+        }
+        return static_cast<size_t>(mix64(account) % velocity_.size()); // hashed ids spread evenly over the rows
+    }
+
+    void gather(const PaymentRequest *requests, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            size_t a = rowOf(requests[i].account);
+            in_row_[i] = a;
+            in_velocity_[i] = velocity_[a];
+            in_last_[i] = last_seen_[a];
+            in_mean_[i] = mean_[a];
+            in_variance_[i] = variance_[a];
+            in_amount_[i] = static_cast<float>(requests[i].amount);
+            in_region_[i] = requests[i].region;
+            in_home_[i] = home_region_[a];
+        }
+    }
+
+    // Straight-line float math shared by the batch kernel and screenOne()
+    static float riskScore(const Weights &w, float now, float last_velocity, float last_seen, float mean,
+                           float variance, float amount, uint16_t region, uint16_t home, float &velocity)
+    {
+        velocity = last_velocity / (1.0f + (now - last_seen) * kInvDecaySeconds) + 1.0f;
+        float delta = amount - mean;
+        float z2 = std::min(delta * delta / (variance + 1.0f), 25.0f);
+        float geo = static_cast<float>((region != 0) & (home != 0) & (region != home));
+        return w.bias + w.velocity * velocity + w.amount_z2 * z2 + w.geo_mismatch * geo;
+    }
+
+    // Hot kernel: straight-line float math over the scratch columns, no branches. It always scores the
+    // full kBatch (stale lanes past the batch are ignored) so the trip count is a compile-time constant.
+    void score(float now)
+    {
+        const Weights w = weights_;
+        for (size_t i = 0; i < kBatch; ++i) {
+            scores_[i] = riskScore(w, now, in_velocity_[i], in_last_[i], in_mean_[i], in_variance_[i], in_amount_[i],
+                                   in_region_[i], in_home_[i], out_velocity_[i]);
+        }
+    }
+
+    void update(size_t n, float now)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            updateRow(in_row_[i], in_amount_[i], out_velocity_[i], now);
+        }
+    }
+    void updateRow(size_t row, float amount, float velocity, float now)
+    {
+        float delta = amount - mean_[row];
+        velocity_[row] = velocity;
+        last_seen_[row] = now;
+        mean_[row] += kAlpha * delta;
+        variance_[row] = (1.0f - kAlpha) * (variance_[row] + kAlpha * delta * delta);
+    }
+
+    static constexpr float kInvDecaySeconds = 1.0f / 60.0f;
+    static constexpr float kAlpha = 0.1f; // EWMA weight of the newest amount
+
+    std::mutex mutex_;
+    Weights weights_;
+    std::vector<float> velocity_, last_seen_, mean_, variance_;
+    std::vector<uint16_t> home_region_;
+    std::chrono::steady_clock::time_point origin_;
+    alignas(64) std::array<float, kBatch> in_velocity_{}, in_last_{}, in_mean_{}, in_variance_{}, in_amount_{};
+    alignas(64) std::array<uint16_t, kBatch> in_region_{}, in_home_{};
+    alignas(64) std::array<float, kBatch> out_velocity_{}, scores_{};
+    std::array<size_t, kBatch> in_row_{};
+};
+
+// PayPalBatch: PayPal payments keyed by canonical account id and routed to shards by that id alone.
+// However the address is spelled, a repeat of the same account and amount within the batch (a double
+// submit) is dropped after one hash probe instead of string compares.
+class PayPalBatch {
+public:
+    enum class Result { Added, Duplicate, Invalid };
+
+    explicit PayPalBatch(size_t shards) : shards_(shards) {}
+
+    Result add(std::string_view email, double amount)
+    {
+        if (!EmailAddress::canonicalize(email, scratch_)) {
+            return Result::Invalid;
+        }
+        uint64_t account = EmailAddress::accountId(scratch_);
+        auto cents = static_cast<uint64_t>(std::llround(amount * 100.0));
+        uint64_t key = account ^ mix64(cents + 0x9e3779b97f4a7c15ULL);
+        if (!seen_.insert(key, cents)) {
+            return Result::Duplicate;
+        }
+        shards_[shardOf(account)].push_back(PaymentRequest{account, amount, 0});
+        return Result::Added;
+    }
+    size_t shardOf(uint64_t account) const { return account % shards_.size(); }
+    size_t shards() const { return shards_.size(); }
+    const std::vector<PaymentRequest> &shard(size_t index) const { return shards_[index]; }
+
+private:
+    std::vector<std::vector<PaymentRequest>> shards_;
+    FlatHashMap64 seen_;
+    std::string scratch_;
+};
+
+// StrategyDeleter: releases a strategy to the pool it came from, or with delete if it has none
+struct StrategyDeleter {
+    std::pmr::memory_resource *resource = nullptr;
+    void *block = nullptr;
+    size_t size = 0, align = 0;
+
+    void operator()(PaymentStrategy *strategy) const
+    {
+        if (!resource) {
+            delete strategy;
+            return;
+        }
+        strategy->~PaymentStrategy();
+        resource->deallocate(block, size, align);
+    }
+};
+using PooledStrategy = std::unique_ptr<PaymentStrategy, StrategyDeleter>;
+
+// StrategyPool: per-thread pool for strategies created per request. The object and its strings come from
+// the thread's unsynchronized pool resource, so steady-state create/destroy never reaches malloc.
+// A pooled strategy must be destroyed on the thread that created it.
+class StrategyPool {
+public:
+    template <typename T, typename... Args>
+    static PooledStrategy make(Args &&...args)
+    {
+        std::pmr::memory_resource *resource = &forThread();
+        void *block = resource->allocate(sizeof(T), alignof(T));
+        T *strategy;
+        try {
+            strategy = new (block) T(std::forward<Args>(args)..., typename T::allocator_type(resource));
+        } catch (...) {
+            // e.g. PayPalPayment rejects an invalid email: hand the block back before propagating
+            resource->deallocate(block, sizeof(T), alignof(T));
+            throw;
+        }
+        return PooledStrategy(strategy, StrategyDeleter{resource, block, sizeof(T), alignof(T)});
+    }
+
+private:
+    static std::pmr::unsynchronized_pool_resource &forThread()
+    {
+        thread_local std::pmr::unsynchronized_pool_resource pool;
+        return pool;
+    }
+};
+
+// PaymentContext
+class PaymentContext {
+public:
+    PaymentContext() : metrics_(std::make_shared<PaymentMetrics>()) {}
+    explicit PaymentContext(std::shared_ptr<PaymentMetrics> metrics) : metrics_(std::move(metrics)) {}
+
+    void setPaymentStrategy(std::unique_ptr<PaymentStrategy> strategy)
+    {
+        setPaymentStrategy(PooledStrategy(strategy.release()));
+    }
+    // Leaves the current strategy in place if the metrics cannot take another one
+    void setPaymentStrategy(PooledStrategy strategy)
+    {
+        if (strategy) {
+            std::string name = strategy->getName();
+            metrics_slot_ = metrics_->slotFor(name);
+            strategy_name_ = std::move(name);
+        }
+        payment_strategy_ = std::move(strategy);
+    }
+    // Successful payments are appended to the ledger; nullptr disables recording
+    void setLedger(PaymentLedger *ledger) { ledger_ = ledger; }
+    // Screens payments before they reach the strategy; nullptr disables screening
+    void setFraudScreen(FraudScreen *screen) { fraud_screen_ = screen; }
+    // Destination of the context's own log lines; nullptr silences them
+    void setOutput(std::ostream *out) { out_ = out; }
+    bool processPayment(double amount, uint64_t account = 0) const
+    {
+        if (payment_strategy_) {
+            if (out_) {
+                *out_ << "💳 Using " << strategy_name_ << " payment method" << std::endl;
+            }
+            if (fraud_screen_ && !fraud_screen_->screenOne(PaymentRequest{account, amount, 0})) {
+                return false;
+            }
+            bool ok = metrics_->recordPayment(metrics_slot_, amount, [&] { return payment_strategy_->pay(amount); });
+            if (ok && ledger_) {
+                ledger_->append(account, amount, strategy_name_);
+            }
+            return ok;
+        } else {
+            if (out_) {
+                *out_ << "❌ No payment method selected!" << std::endl;
+            }
+            return false;
+        }
+    }
+    bool refundPayment(double amount) const { return payment_strategy_ && payment_strategy_->refund(amount); }
+    // Screens the whole batch, then authorizes the allowed payments with one payBatch() call
+    std::vector<bool> processBatch(const std::vector<PaymentRequest> &requests) const
+    {
+        std::vector<bool> results(requests.size(), false);
+        if (!payment_strategy_) {
+            return results;
+        }
+        std::vector<uint8_t> allowed(requests.size(), 1);
+        if (fraud_screen_) {
+            fraud_screen_->screen(requests, allowed);
+        }
+        std::vector<double> amounts;
+        for (size_t i = 0; i < requests.size(); ++i) {
+            if (allowed[i]) {
+                amounts.push_back(requests[i].amount);
+            }
+        }
+        uint64_t start = CycleClock::now();
+        std::vector<bool> paid = payment_strategy_->payBatch(amounts);
+        auto latency = CycleClock::since(start);
+        for (size_t i = 0, j = 0; i < requests.size(); ++i) {
+            if (!allowed[i]) {
+                continue;
+            }
+            results[i] = paid[j++];
+            metrics_->record(metrics_slot_, results[i], requests[i].amount, latency);
+            if (results[i] && ledger_) {
+                ledger_->append(requests[i].account, requests[i].amount, strategy_name_);
+            }
+        }
+        return results;
+    }
+    const PaymentMetrics &metrics() const { return *metrics_; }
+
+private:
+    PooledStrategy payment_strategy_;
+    std::shared_ptr<PaymentMetrics> metrics_;
+    size_t metrics_slot_ = 0;
+    std::string strategy_name_;
+    std::ostream *out_ = &std::cout;
+    PaymentLedger *ledger_ = nullptr;
+    FraudScreen *fraud_screen_ = nullptr;
+};
+
+// Currency codes with their number of minor-unit digits
+enum class Currency : uint8_t { USD, EUR, GBP, JPY, CNY };
+constexpr size_t kCurrencyCount = 5;
+constexpr std::array<std::string_view, kCurrencyCount> kCurrencyCodes{"USD", "EUR", "GBP", "JPY", "CNY"};
+constexpr std::array<int, kCurrencyCount> kCurrencyMinorDigits{2, 2, 2, 0, 2};
+constexpr std::array<double, kCurrencyCount> kCurrencyMinorPerUnit{100.0, 100.0, 100.0, 1.0, 100.0};
+
+// Money: integral amount in the currency's minor unit (cents, yen, ...)
+struct Money {
+    int64_t minor;
+    Currency currency;
+
+    static Money fromDecimal(double amount, Currency currency)
+    {
+        return {std::llround(amount * scale(currency)), currency};
+    }
+    double toDecimal() const { return static_cast<double>(minor) / scale(currency); }
+    static double scale(Currency currency) { return kCurrencyMinorPerUnit[static_cast<size_t>(currency)]; }
+};
+
+// Formats the integral minor units into a local buffer, so the caller's stream flags and precision are
+// left as they were (only the field width, if set, applies to the whole amount)
+std::ostream &operator<<(std::ostream &out, const Money &money)
+{
+    auto index = static_cast<size_t>(money.currency);
+    int digits = kCurrencyMinorDigits[index];
+    auto per_unit = static_cast<uint64_t>(kCurrencyMinorPerUnit[index]);
+    uint64_t magnitude = money.minor < 0 ? 0 - static_cast<uint64_t>(money.minor) : static_cast<uint64_t>(money.minor);
+    std::string_view code = kCurrencyCodes[index];
+    char text[48];
+    int length = digits > 0 ? std::snprintf(text, sizeof(text), "%s%llu.%0*llu %.*s", money.minor < 0 ? "-" : "",
+                                            static_cast<unsigned long long>(magnitude / per_unit), digits,
+                                            static_cast<unsigned long long>(magnitude % per_unit),
+                                            static_cast<int>(code.size()), code.data())
+                            : std::snprintf(text, sizeof(text), "%s%llu %.*s", money.minor < 0 ? "-" : "",
+                                            static_cast<unsigned long long>(magnitude), static_cast<int>(code.size()),
+                                            code.data());
+    return out << std::string_view(text, static_cast<size_t>(length));
+}
+
+// FxRateTable: USD value of one unit of each currency. A single publisher fills a spare snapshot from a
+// small ring and swaps the current pointer; readers never take a lock and never wait on the publisher.
+// Each snapshot carries a sequence number, so a reader that raced with the reuse of its snapshot (only
+// possible after kRing newer publishes) simply reads again.
+class FxRateTable {
+public:
+    using Rates = std::array<double, kCurrencyCount>;
+
+    explicit FxRateTable(const Rates &usd_per_unit) { publish(usd_per_unit); }
+
+    // Single writer
+    void publish(const Rates &usd_per_unit)
+    {
+        Snapshot &next = ring_[published_ % kRing];
+        uint64_t seq = next.seq.load(std::memory_order_relaxed);
+        next.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < kCurrencyCount; ++i) {
+            next.usd_per_unit[i].store(usd_per_unit[i], std::memory_order_relaxed);
+        }
+        next.version.store(++published_, std::memory_order_relaxed);
+        next.seq.store(seq + 2, std::memory_order_release);
+        current_.store(&next, std::memory_order_release);
+    }
+
+    // Units of `to` per unit of `from`, from one consistent snapshot
+    double rate(Currency from, Currency to, uint64_t *version = nullptr) const
+    {
+        for (;;) {
+            const Snapshot *snapshot = current_.load(std::memory_order_acquire);
+            uint64_t seq = snapshot->seq.load(std::memory_order_acquire);
+            double from_usd = snapshot->usd_per_unit[static_cast<size_t>(from)].load(std::memory_order_relaxed);
+            double to_usd = snapshot->usd_per_unit[static_cast<size_t>(to)].load(std::memory_order_relaxed);
+            uint64_t v = snapshot->version.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if ((seq & 1) == 0 && snapshot->seq.load(std::memory_order_relaxed) == seq) {
+                if (version) {
+                    *version = v;
+                }
+                return from_usd / to_usd;
+            }
+        }
+    }
+
+    Money convert(const Money &money, Currency to) const
+    {
+        double units = money.toDecimal() * rate(money.currency, to);
+        return Money::fromDecimal(units, to);
+    }
+
+private:
+    static constexpr size_t kRing = 8;
+
+    struct Snapshot {
+        std::atomic<uint64_t> seq{0}; // odd while being written
+        std::atomic<uint64_t> version{0};
+        std::array<std::atomic<double>, kCurrencyCount> usd_per_unit{};
+    };
+
+    std::array<Snapshot, kRing> ring_;
+    std::atomic<const Snapshot *> current_{nullptr};
+    uint64_t published_ = 0; // writer-only
+};
+
+// CurrencyGateway: accepts payments in any currency and settles them in USD through a PaymentContext
+class CurrencyGateway {
+public:
+    CurrencyGateway(const FxRateTable &rates, const PaymentContext &context) : rates_(rates), context_(context) {}
+
+    // Returns the settled USD amount, or nullopt if the payment failed
+    std::optional<Money> pay(const Money &money, uint64_t account = 0) const
+    {
+        Money settled = rates_.convert(money, Currency::USD);
+        if (!context_.processPayment(settled.toDecimal(), account)) {
+            return std::nullopt;
+        }
+        return settled;
+    }
+
+private:
+    const FxRateTable &rates_;
+    const PaymentContext &context_;
+};
+
+// IdempotentPayments: runs PaymentContext::processPayment at most once per idempotency key. The first
+// attempt's result is cached for the TTL, counted from its completion, and returned to retries; duplicates
+// that arrive while the first attempt is in flight wait for it (single-flight). Keys live in a sharded map,
+// each shard capped at max_entries / shards entries. In-flight keys are pinned: only completed entries
+// expire or are evicted (oldest completion first), and a shard full of in-flight keys rejects new ones.
+class IdempotentPayments {
+public:
+    struct Stats {
+        uint64_t executed = 0, replayed = 0, coalesced = 0, rejected = 0;
+    };
+
+    IdempotentPayments(const PaymentContext &context, size_t shards, size_t max_entries,
+                       std::chrono::milliseconds ttl)
+        : context_(context), shards_(std::max<size_t>(shards, 1)),
+          per_shard_limit_(std::max<size_t>(max_entries / shards_.size(), 1)), ttl_(ttl)
+    {
+    }
+
+    // Throws std::runtime_error when the key's shard is full of in-flight payments; the caller may retry
+    bool processPayment(const std::string &key, double amount, uint64_t account = 0)
+    {
+        Shard &shard = shards_[std::hash<std::string>{}(key) % shards_.size()];
+        std::promise<bool> leader;
+        std::shared_future<bool> result;
+        uint64_t attempt = 0;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            evictExpired(shard, std::chrono::steady_clock::now());
+            auto it = shard.entries.find(key);
+            if (it != shard.entries.end()) {
+                if (it->second.amount != amount) {
+                    throw std::invalid_argument("idempotency key reused with a different amount: " + key);
+                }
+                result = it->second.result;
+                (it->second.pending ? coalesced_ : replayed_).fetch_add(1, std::memory_order_relaxed);
+            } else {
+                if (shard.entries.size() >= per_shard_limit_) {
+                    if (shard.completed.empty()) {
+                        rejected_.fetch_add(1, std::memory_order_relaxed);
+                        throw std::runtime_error("idempotency table full of in-flight payments: " + key);
+                    }
+                    shard.entries.erase(shard.completed.front());
+                    shard.completed.pop_front();
+                }
+                result = leader.get_future().share();
+                attempt = ++shard.attempts;
+                shard.entries.emplace(key, Entry{amount, result, {}, attempt, true, {}});
+            }
+        }
+        if (attempt == 0) {
+            return result.get();
+        }
+        try {
+            bool ok = context_.processPayment(amount, account);
+            executed_.fetch_add(1, std::memory_order_relaxed);
+            {
+                // Unpin the entry; its TTL starts now
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                auto it = shard.entries.find(key);
+                if (it != shard.entries.end() && it->second.attempt == attempt) {
+                    it->second.pending = false;
+                    it->second.expires = std::chrono::steady_clock::now() + ttl_;
+                    it->second.order = shard.completed.insert(shard.completed.end(), key);
+                }
+            }
+            leader.set_value(ok);
+            return ok;
+        } catch (...) {
+            // Waiters see the error, but the key is released so a later retry runs again
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                auto it = shard.entries.find(key);
+                if (it != shard.entries.end() && it->second.attempt == attempt) {
+                    shard.entries.erase(it);
+                }
+            }
+            leader.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    Stats stats() const
+    {
+        return {executed_.load(std::memory_order_relaxed), replayed_.load(std::memory_order_relaxed),
+                coalesced_.load(std::memory_order_relaxed), rejected_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    struct Entry {
+        double amount;
+        std::shared_future<bool> result;
+        std::chrono::steady_clock::time_point expires; // set on completion
+        uint64_t attempt;
+        bool pending;
+        std::list<std::string>::iterator order; // position in Shard::completed once completed
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> completed; // completed keys, oldest completion first
+        uint64_t attempts = 0;
+    };
+
+    // Completed entries are appended in completion order with a fixed TTL, so expired ones are at the front
+    static void evictExpired(Shard &shard, std::chrono::steady_clock::time_point now)
+    {
+        while (!shard.completed.empty()) {
+            auto it = shard.entries.find(shard.completed.front());
+            if (it->second.expires > now) {
+                break;
+            }
+            shard.entries.erase(it);
+            shard.completed.pop_front();
+        }
+    }
+
+    const PaymentContext &context_;
+    std::vector<Shard> shards_;
+    size_t per_shard_limit_;
+    std::chrono::milliseconds ttl_;
+    std::atomic<uint64_t> executed_{0}, replayed_{0}, coalesced_{0}, rejected_{0};
+};
+
+// ZipfDistribution: draws ranks in [0, n) with P(k) proportional to 1 / (k + 1)^s
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t n, double s) : cdf_(n)
+    {
+        double sum = 0.0;
+        for (size_t k = 0; k < n; ++k) {
+            sum += 1.0 / std::pow(static_cast<double>(k + 1), s);
+            cdf_[k] = sum;
+        }
+        for (double &c : cdf_) {
+            c /= sum;
+        }
+    }
+    template <typename Rng>
+    size_t operator()(Rng &rng) const
+    {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        return std::min(static_cast<size_t>(std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin()),
+                        cdf_.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf_;
+};
+
+// ShardedPaymentProcessor: accounts are hashed onto per-core shards. Each shard thread owns its
+// accounts and its PaymentContext, so balances and limits are never locked; shards talk only through
+// their inboxes. A transfer is a two-phase exchange: the source shard debits and holds the funds,
+// the destination shard credits (or refuses), and the source shard then commits or refunds.
+class ShardedPaymentProcessor {
+public:
+    using StrategyFactory = std::function<std::unique_ptr<PaymentStrategy>()>;
+
+    ShardedPaymentProcessor(size_t shards, size_t accounts, double initial_balance, double payment_limit,
+                            const StrategyFactory &factory)
+        : metrics_(std::make_shared<PaymentMetrics>())
+    {
+        for (size_t i = 0; i < shards; ++i) {
+            shards_.push_back(std::make_unique<Shard>(metrics_));
+            shards_.back()->context.setPaymentStrategy(factory());
+            shards_.back()->context.setOutput(nullptr);
+        }
+        for (uint64_t id = 0; id < accounts; ++id) {
+            shards_[shardOf(id)]->accounts[id] = Account{initial_balance, payment_limit, 0.0};
+        }
+        for (auto &shard : shards_) {
+            shard->worker = std::thread([this, s = shard.get()] { run(*s); });
+        }
+    }
+    ~ShardedPaymentProcessor()
+    {
+        for (auto &shard : shards_) {
+            {
+                std::lock_guard<std::mutex> lock(shard->mutex);
+                shard->stopping = true;
+            }
+            shard->cv.notify_one();
+        }
+        for (auto &shard : shards_) {
+            shard->worker.join();
+        }
+    }
+
+    // Amounts that are not finite or not positive are declined before they are routed to a shard
+    std::future<bool> pay(uint64_t account, double amount)
+    {
+        return submit(Message{Message::Pay, account, 0, amount, {}});
+    }
+    std::future<bool> transfer(uint64_t from, uint64_t to, double amount)
+    {
+        return submit(Message{Message::TransferDebit, from, to, amount, {}});
+    }
+    // Reverses a payment through the shard's strategy and credits the account back
+    std::future<bool> refund(uint64_t account, double amount)
+    {
+        return submit(Message{Message::Refund, account, 0, amount, {}});
+    }
+    const PaymentMetrics &metrics() const { return *metrics_; }
+
+private:
+    struct Account {
+        double balance, payment_limit, held;
+    };
+    struct Message {
+        enum Kind : uint8_t { Pay, Refund, TransferDebit, TransferCredit, TransferCommit, TransferAbort } kind;
+        uint64_t account, counterparty;
+        double amount;
+        std::promise<bool> reply;
+    };
+    struct Shard {
+        explicit Shard(std::shared_ptr<PaymentMetrics> metrics) : context(std::move(metrics)) {}
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<Message> inbox;
+        bool stopping = false;
+        // Owned by the shard thread only
+        std::unordered_map<uint64_t, Account> accounts;
+        PaymentContext context;
+        std::thread worker;
+    };
+
+    size_t shardOf(uint64_t account) const
+    {
+        // One splitmix64 step spreads sequential ids evenly over shards
+        return static_cast<size_t>(mix64(account + 0x9e3779b97f4a7c15ULL) % shards_.size());
+    }
+    std::future<bool> submit(Message message)
+    {
+        std::future<bool> result = message.reply.get_future();
+        if (!std::isfinite(message.amount) || message.amount <= 0.0) {
+            message.reply.set_value(false);
+            return result;
+        }
+        post(std::move(message));
+        return result;
+    }
+    void post(Message message)
+    {
+        Shard &shard = *shards_[shardOf(message.account)];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.inbox.push_back(std::move(message));
+        }
+        shard.cv.notify_one();
+    }
+
+    void run(Shard &shard)
+    {
+        std::vector<Message> batch;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(shard.mutex);
+                shard.cv.wait(lock, [&] { return shard.stopping || !shard.inbox.empty(); });
+                if (shard.inbox.empty()) {
+                    return;
+                }
+                batch.swap(shard.inbox);
+            }
+            for (Message &message : batch) {
+                handle(shard, message);
+            }
+            batch.clear();
+        }
+    }
+
+    // Replies with the outcome of a strategy call; an exception from the strategy goes to the caller
+    // instead of unwinding (and terminating) the shard thread
+    template <typename Call>
+    static void answer(Message &m, Call &&call)
+    {
+        try {
+            m.reply.set_value(call());
+        } catch (...) {
+            m.reply.set_exception(std::current_exception());
+        }
+    }
+    void handle(Shard &shard, Message &m)
+    {
+        auto it = shard.accounts.find(m.account);
+        Account *account = it == shard.accounts.end() ? nullptr : &it->second;
+        switch (m.kind) {
+            case Message::Pay:
+                answer(m, [&] {
+                    bool ok = account && m.amount <= account->payment_limit && m.amount <= account->balance &&
+                              shard.context.processPayment(m.amount, m.account);
+                    if (ok) {
+                        account->balance -= m.amount;
+                    }
+                    return ok;
+                });
+                break;
+            case Message::Refund:
+                answer(m, [&] {
+                    bool ok = account && shard.context.refundPayment(m.amount);
+                    if (ok) {
+                        account->balance += m.amount;
+                    }
+                    return ok;
+                });
+                break;
+            case Message::TransferDebit:
+                // Phase 1: hold the funds at the source, then ask the destination shard
+                if (!account || m.amount > account->balance) {
+                    m.reply.set_value(false);
+                    break;
+                }
+                account->balance -= m.amount;
+                account->held += m.amount;
+                post(Message{Message::TransferCredit, m.counterparty, m.account, m.amount, std::move(m.reply)});
+                break;
+            case Message::TransferCredit:
+                if (account) {
+                    account->balance += m.amount;
+                }
+                post(Message{account ? Message::TransferCommit : Message::TransferAbort, m.counterparty, m.account,
+                             m.amount, std::move(m.reply)});
+                break;
+            case Message::TransferCommit:
+            case Message::TransferAbort:
+                // Phase 2: release the hold; refund it if the destination refused
+                account->held -= m.amount;
+                if (m.kind == Message::TransferAbort) {
+                    account->balance += m.amount;
+                }
+                m.reply.set_value(m.kind == Message::TransferCommit);
+                break;
+        }
+    }
+
+    std::shared_ptr<PaymentMetrics> metrics_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+// Runs sequential payments and formats p50/p99/p999 latency
+std::string measureTailLatency(const PaymentStrategy &strategy, size_t payments)
+{
+    std::vector<int64_t> samples;
+    samples.reserve(payments);
+    for (size_t i = 0; i < payments; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        strategy.pay(1.0);
+        samples.push_back(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(samples.begin(), samples.end());
+    auto at = [&](double p) { return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))]; };
+    return "p50=" + std::to_string(at(0.50)) + "us p99=" + std::to_string(at(0.99)) +
+           "us p999=" + std::to_string(at(0.999)) + "us";
+}
+
+// Drives a strategy from concurrent clients (closed loop) and formats throughput and mean latency
+std::string measureThroughput(const PaymentStrategy &strategy, size_t clients, size_t payments_per_client)
+{
+    std::atomic<int64_t> total_latency_us{0};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < clients; ++c) {
+        threads.emplace_back([&] {
+            for (size_t i = 0; i < payments_per_client; ++i) {
+                auto begin = std::chrono::steady_clock::now();
+                strategy.pay(1.0);
+                total_latency_us.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(
+                                               std::chrono::steady_clock::now() - begin)
+                                               .count(),
+                                           std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t payments = clients * payments_per_client;
+    return std::to_string(static_cast<int64_t>(static_cast<double>(payments) / seconds)) +
+           " payments/s, mean latency " + std::to_string(total_latency_us.load() / static_cast<int64_t>(payments)) +
+           "us";
+}
+
+// Pays from accounts drawn by pick() with one producer per shard; formats payments/s
+template <typename Picker>
+std::string measureShardedThroughput(size_t shards, size_t payments, Picker pick)
+{
+    ShardedPaymentProcessor processor(shards, 10000, 1e9, 1e6, [] {
+        return std::make_unique<MockGatewayPayment>(std::chrono::microseconds(0), 0.0);
+    });
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < shards; ++p) {
+        producers.emplace_back([&, p] {
+            std::mt19937_64 rng(p);
+            std::vector<std::future<bool>> results;
+            results.reserve(payments / shards);
+            for (size_t i = 0; i < payments / shards; ++i) {
+                results.push_back(processor.pay(pick(rng), 1.0));
+            }
+            for (auto &r : results) {
+                r.get();
+            }
+        });
+    }
+    for (auto &t : producers) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return std::to_string(static_cast<int64_t>(static_cast<double>(payments) / seconds)) + " payments/s";
+}
+
+// Appends from several threads, then scans everything back; formats both rates
+std::string measureLedger(PaymentLedger &ledger, size_t writers, size_t records_per_writer)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < writers; ++w) {
+        threads.emplace_back([&, w] {
+            for (size_t i = 0; i < records_per_writer; ++i) {
+                ledger.append(w, 1.0, "Mock Gateway");
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    double append_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    double total = 0.0;
+    uint64_t scanned = ledger.scan(0, [&](const LedgerRecord &record) { total += record.amount; });
+    double scan_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return std::to_string(static_cast<int64_t>(static_cast<double>(writers * records_per_writer) / append_seconds)) +
+           " appends/s, scan " + std::to_string(static_cast<int64_t>(static_cast<double>(scanned) / scan_seconds)) +
+           " records/s";
+}
+
+// LoadGenerator: open-loop synthetic load against PaymentContexts. Arrival times are scheduled up front
+// and latency is measured from each payment's intended start, so a stalled system cannot slow the
+// generator down and hide its own queueing delay (coordinated omission).
+class LoadGenerator {
+public:
+    struct Options {
+        double rate = 2000.0;               // payments per second
+        double duration_s = 2.0;
+        std::string arrival = "poisson";    // poisson | bursty
+        std::string mix = "direct:1";       // strategy:weight,... (direct, hedged, breaker, batched)
+        double amount_median = 50.0, amount_sigma = 1.0;
+        size_t accounts = 100000;
+        double zipf = 1.1;                  // 0 = uniform account popularity
+        size_t workers = 64;
+        int64_t gateway_median_us = 200;
+        size_t connections = 0;
+        bool json = false;
+    };
+
+    static bool parse(const std::vector<std::string> &args, Options &o)
+    {
+        for (size_t i = 0; i + 1 < args.size(); i += 2) {
+            const std::string &key = args[i], &value = args[i + 1];
+            if (key == "--rate") {
+                o.rate = std::stod(value);
+            } else if (key == "--duration") {
+                o.duration_s = std::stod(value);
+            } else if (key == "--arrival") {
+                o.arrival = value;
+            } else if (key == "--mix") {
+                o.mix = value;
+            } else if (key == "--amount-median") {
+                o.amount_median = std::stod(value);
+            } else if (key == "--amount-sigma") {
+                o.amount_sigma = std::stod(value);
+            } else if (key == "--accounts") {
+                o.accounts = std::stoul(value);
+            } else if (key == "--zipf") {
+                o.zipf = std::stod(value);
+            } else if (key == "--workers") {
+                o.workers = std::stoul(value);
+            } else if (key == "--gateway-median-us") {
+                o.gateway_median_us = std::stol(value);
+            } else if (key == "--connections") {
+                o.connections = std::stoul(value);
+            } else if (key == "--json") {
+                o.json = value == "1" || value == "true";
+            } else {
+                return false;
+            }
+        }
+        // Zero accounts would divide by zero when picking one; zero workers would never send a payment
+        return args.size() % 2 == 0 && (o.arrival == "poisson" || o.arrival == "bursty") && o.rate > 0 &&
+               o.amount_median > 0 && o.accounts > 0 && o.workers > 0;
+    }
+
+    static void usage(std::ostream &out)
+    {
+        out << "Usage: strategy --loadgen [--rate N] [--duration S] [--arrival poisson|bursty]\n"
+               "                [--mix direct:W,hedged:W,breaker:W,batched:W] [--amount-median X]\n"
+               "                [--amount-sigma X] [--accounts N] [--zipf S] [--workers N]\n"
+               "                [--gateway-median-us N] [--connections N] [--json true]"
+            << std::endl;
+    }
+
+    explicit LoadGenerator(Options options) : o_(std::move(options)), metrics_(std::make_shared<PaymentMetrics>())
+    {
+        auto gateway = std::make_shared<MockGatewayPayment>(std::chrono::microseconds(o_.gateway_median_us), 1.0,
+                                                            0.0, o_.connections);
+        std::stringstream mix(o_.mix);
+        for (std::string entry; std::getline(mix, entry, ',');) {
+            auto colon = entry.find(':');
+            std::string name = entry.substr(0, colon);
+            double weight = colon == std::string::npos ? 1.0 : std::stod(entry.substr(colon + 1));
+            auto context = std::make_unique<PaymentContext>(metrics_);
+            context->setOutput(nullptr);
+            context->setPaymentStrategy(makeStrategy(name, gateway));
+            contexts_.push_back(std::move(context));
+            weights_.push_back(weight);
+        }
+    }
+
+    int run(std::ostream &out)
+    {
+        std::vector<Request> schedule = buildSchedule();
+        std::vector<int64_t> latency_us(schedule.size());
+        std::atomic<size_t> next{0};
+        auto origin = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (size_t w = 0; w < o_.workers; ++w) {
+            workers.emplace_back([&] {
+                for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < schedule.size();) {
+                    const Request &r = schedule[i];
+                    auto intended = origin + r.offset;
+                    std::this_thread::sleep_until(intended);
+                    contexts_[r.context]->processPayment(r.amount, r.account);
+                    latency_us[i] = std::chrono::duration_cast<std::chrono::microseconds>(
+                                        std::chrono::steady_clock::now() - intended)
+                                        .count();
+                }
+            });
+        }
+        for (auto &t : workers) {
+            t.join();
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+        report(out, latency_us, elapsed);
+        return 0;
+    }
+
+private:
+    struct Request {
+        std::chrono::nanoseconds offset;
+        size_t context;
+        uint64_t account;
+        double amount;
+    };
+
+    static std::unique_ptr<PaymentStrategy> makeStrategy(const std::string &name,
+                                                         const std::shared_ptr<MockGatewayPayment> &gateway)
+    {
+        if (name == "hedged") {
+            return std::make_unique<HedgedPayment>(gateway, std::chrono::microseconds(1000));
+        } else if (name == "breaker") {
+            return std::make_unique<CircuitBreakerPayment>(gateway, 5, std::chrono::milliseconds(100));
+        } else if (name == "batched") {
+            return std::make_unique<BatchingPayment>(gateway, 64, std::chrono::microseconds(200));
+        } else if (name == "direct") {
+            return std::make_unique<ProxyPayment>(gateway);
+        }
+        throw std::invalid_argument("unknown strategy in mix: " + name);
+    }
+
+    // Forwards to a shared strategy so several contexts can use one gateway
+    class ProxyPayment : public PaymentStrategy {
+    public:
+        explicit ProxyPayment(std::shared_ptr<PaymentStrategy> inner) : inner_(std::move(inner)) {}
+        bool pay(double amount) const override { return inner_->pay(amount); }
+        bool isIdempotent() const override { return inner_->isIdempotent(); }
+        std::string getName() const override { return inner_->getName(); }
+
+    private:
+        std::shared_ptr<PaymentStrategy> inner_;
+    };
+
+    std::vector<Request> buildSchedule() const
+    {
+        std::mt19937_64 rng(42);
+        std::discrete_distribution<size_t> pick_context(weights_.begin(), weights_.end());
+        std::lognormal_distribution<double> amount(std::log(o_.amount_median), o_.amount_sigma);
+        std::unique_ptr<ZipfDistribution> zipf;
+        if (o_.zipf > 0) {
+            zipf = std::make_unique<ZipfDistribution>(o_.accounts, o_.zipf);
+        }
+        // Bursty arrivals alternate 100ms at 1.75x and 100ms at 0.25x the mean rate
+        auto rate_at = [&](double t) {
+            if (o_.arrival == "poisson") {
+                return o_.rate;
+            }
+            return static_cast<int64_t>(t * 10) % 2 == 0 ? o_.rate * 1.75 : o_.rate * 0.25;
+        };
+        std::vector<Request> schedule;
+        schedule.reserve(static_cast<size_t>(o_.rate * o_.duration_s * 1.1));
+        for (double t = 0.0;;) {
+            t += std::exponential_distribution<double>(rate_at(t))(rng);
+            if (t >= o_.duration_s) {
+                break;
+            }
+            uint64_t account = zipf ? (*zipf)(rng) : rng() % o_.accounts;
+            schedule.push_back({std::chrono::nanoseconds(static_cast<int64_t>(t * 1e9)), pick_context(rng), account,
+                                std::round(amount(rng) * 100.0) / 100.0});
+        }
+        return schedule;
+    }
+
+    void report(std::ostream &out, std::vector<int64_t> &latency_us, double elapsed) const
+    {
+        std::sort(latency_us.begin(), latency_us.end());
+        auto at = [&](double p) {
+            return latency_us.empty()
+                       ? 0
+                       : latency_us[std::min(latency_us.size() - 1, static_cast<size_t>(p * latency_us.size()))];
+        };
+        double throughput = static_cast<double>(latency_us.size()) / elapsed;
+        if (o_.json) {
+            out << "{\"payments\":" << latency_us.size() << ",\"throughput\":" << std::fixed << std::setprecision(1)
+                << throughput << ",\"latency_us\":{\"p50\":" << at(0.50) << ",\"p90\":" << at(0.90)
+                << ",\"p99\":" << at(0.99) << ",\"p999\":" << at(0.999)
+                << ",\"max\":" << (latency_us.empty() ? 0 : latency_us.back()) << "},\"metrics\":";
+            metrics_->dumpJson(out);
+            out << "}" << std::endl;
+            return;
+        }
+        out << "📈 Load generator: " << o_.arrival << " arrivals at " << o_.rate << "/s for " << o_.duration_s
+            << "s, mix " << o_.mix << std::endl;
+        out << "   payments=" << latency_us.size() << " throughput=" << std::fixed << std::setprecision(1)
+            << throughput << "/s" << std::endl;
+        out << "   response time (from intended start): p50=" << at(0.50) << "us p90=" << at(0.90)
+            << "us p99=" << at(0.99) << "us p999=" << at(0.999)
+            << "us max=" << (latency_us.empty() ? 0 : latency_us.back()) << "us" << std::endl;
+        out << "   service time per strategy:" << std::endl;
+        metrics_->dumpText(out);
+    }
+
+    Options o_;
+    std::shared_ptr<PaymentMetrics> metrics_;
+    std::vector<std::unique_ptr<PaymentContext>> contexts_;
+    std::vector<double> weights_;
+};
+
+int runLoadGenerator(const std::vector<std::string> &args)
+{
+    LoadGenerator::Options options;
+    try {
+        if (!LoadGenerator::parse(args, options)) {
+            LoadGenerator::usage(std::cerr);
+            return 1;
+        }
+        return LoadGenerator(options).run(std::cout);
+    } catch (const std::exception &e) {
+        std::cerr << "❌ " << e.what() << std::endl;
+        LoadGenerator::usage(std::cerr);
+        return 1;
+    }
+}
+
+// The receipt path before ReceiptWriter: one flushing iostream write per line
+void renderReceiptWithIostream(std::ostream &out, const std::string &email, double amount)
+{
+    out << "📧 Processing PayPal payment:" << std::endl;
+    out << "   Email: " << email << std::endl;
+    out << "   Amount: $" << std::fixed << std::setprecision(2) << amount << std::endl;
+    out << "   ✅ PayPal payment successful!" << std::endl;
+}
+
+// Renders receipts into /dev/null both ways; formats receipts/s for each
+std::string measureReceipts(size_t receipts)
+{
+    std::ofstream sink("/dev/null");
+    PayPalPayment paypal("john.doe@example.com");
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < receipts; ++i) {
+        renderReceiptWithIostream(sink, "john.doe@example.com", 120.50 + static_cast<double>(i));
+    }
+    double iostream_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ReceiptWriter::forThread().flush();
+    ReceiptWriter::setOutput(&sink);
+    ReceiptWriter::setBatchSize(64);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < receipts; ++i) {
+        paypal.pay(120.50 + static_cast<double>(i));
+    }
+    ReceiptWriter::forThread().flush();
+    double buffered_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ReceiptWriter::setBatchSize(1);
+    ReceiptWriter::setOutput(&std::cout);
+
+    auto rate = [&](double seconds) { return std::to_string(static_cast<int64_t>(receipts / seconds)); };
+    return "iostream " + rate(iostream_s) + " receipts/s, buffered " + rate(buffered_s) + " receipts/s";
+}
+
+// Creates a strategy per payment, as a per-request service would; formats heap allocations per payment
+template <typename MakeStrategy>
+std::string measureAllocationsPerPayment(PaymentContext &context, size_t payments, MakeStrategy make)
+{
+    for (size_t i = 0; i < 100; ++i) { // warm up thread-local buffers and pools
+        context.setPaymentStrategy(make());
+        context.processPayment(1.0);
+    }
+    uint64_t before = AllocationCounter::count();
+    for (size_t i = 0; i < payments; ++i) {
+        context.setPaymentStrategy(make());
+        context.processPayment(1.0);
+    }
+    double per_payment = static_cast<double>(AllocationCounter::count() - before) / static_cast<double>(payments);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << per_payment << " allocations/payment";
+    return out.str();
+}
+
+// PerfCounters: cycles, instructions, branch misses and cache misses of the calling thread via
+// perf_event_open. Counters the kernel refuses (no PMU in a VM, perf_event_paranoid) read as absent.
+class PerfCounters {
+public:
+    static constexpr size_t kCount = 4;
+    static constexpr std::array<std::string_view, kCount> kNames{"cycles", "instructions", "branch_misses",
+                                                                  "cache_misses"};
+
+    PerfCounters()
+    {
+#if defined(__linux__)
+        constexpr std::array<uint64_t, kCount> kConfigs{PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                        PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+        for (size_t i = 0; i < kCount; ++i) {
+            perf_event_attr attr{};
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = kConfigs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds_[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+    ~PerfCounters()
+    {
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool available() const { return fds_[0] >= 0; }
+    void start()
+    {
+#if defined(__linux__)
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+    // Counts since start(); -1 for a counter that is not available
+    std::array<int64_t, kCount> stop()
+    {
+        std::array<int64_t, kCount> counts;
+        counts.fill(-1);
+#if defined(__linux__)
+        for (size_t i = 0; i < kCount; ++i) {
+            uint64_t value = 0;
+            if (fds_[i] >= 0 && ::ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0) == 0 &&
+                ::read(fds_[i], &value, sizeof(value)) == static_cast<ssize_t>(sizeof(value))) {
+                counts[i] = static_cast<int64_t>(value);
+            }
+        }
+#endif
+        return counts;
+    }
+
+private:
+    std::array<int, kCount> fds_{-1, -1, -1, -1};
+};
+
+// Keeps a value alive so the optimizer cannot drop the loop that computes it
+template <typename T>
+void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Trivial strategies for the dispatch benchmarks: little enough work that the call itself shows
+class FlatFeeStrategy : public PaymentStrategy {
+public:
+    bool pay(double amount) const override { return amount + 0.30 > 1.0; }
+    std::string getName() const override { return "Flat Fee"; }
+};
+class PercentFeeStrategy : public PaymentStrategy {
+public:
+    bool pay(double amount) const override { return amount * 1.029 > 1.0; }
+    std::string getName() const override { return "Percent Fee"; }
+};
+
+// StrategyBenchmark: runs each case on the null receipt sink (warm-up, then best of several repetitions)
+// and reports ns/op, heap allocations/op and, where the kernel allows, hardware counters per op
+class StrategyBenchmark {
+public:
+    struct Options {
+        size_t ops = 1000000;
+        size_t repetitions = 5;
+        std::string filter;                 // run only cases whose name contains this
+        bool json = false;
+    };
+
+    static bool parse(const std::vector<std::string> &args, Options &o)
+    {
+        for (size_t i = 0; i + 1 < args.size(); i += 2) {
+            const std::string &key = args[i], &value = args[i + 1];
+            if (key == "--ops") {
+                o.ops = std::stoul(value);
+            } else if (key == "--repetitions") {
+                o.repetitions = std::stoul(value);
+            } else if (key == "--filter") {
+                o.filter = value;
+            } else if (key == "--json") {
+                o.json = value == "1" || value == "true";
+            } else {
+                return false;
+            }
+        }
+        return args.size() % 2 == 0 && o.ops > 0 && o.repetitions > 0;
+    }
+
+    static void usage(std::ostream &out)
+    {
+        out << "Usage: strategy --bench [--ops N] [--repetitions N] [--filter NAME] [--json true]" << std::endl;
+    }
+
+    explicit StrategyBenchmark(Options options) : o_(std::move(options)) {}
+
+    int run(std::ostream &out)
+    {
+        ReceiptWriter::forThread().flush();
+        ReceiptWriter::setOutput(nullptr);
+        benchDispatch();
+        benchSwap();
+        benchBatch();
+        benchMetrics();
+        ReceiptWriter::forThread().flush();
+        ReceiptWriter::setOutput(&std::cout);
+        o_.json ? printJson(out) : printText(out);
+        return 0;
+    }
+
+private:
+    struct Result {
+        std::string name;
+        size_t ops;
+        double ns_per_op, allocs_per_op;
+        std::array<int64_t, PerfCounters::kCount> counters;
+    };
+
+    // body(ops) performs ops operations; the fastest repetition is reported
+    template <typename Body>
+    void measure(const std::string &name, Body body)
+    {
+        if (name.find(o_.filter) == std::string::npos) {
+            return;
+        }
+        body(std::max<size_t>(o_.ops / 10, 1));
+        Result best{name, o_.ops, 0.0, 0.0, {}};
+        for (size_t rep = 0; rep < o_.repetitions; ++rep) {
+            uint64_t allocations = AllocationCounter::count();
+            counters_.start();
+            auto start = std::chrono::steady_clock::now();
+            body(o_.ops);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            auto counts = counters_.stop();
+            allocations = AllocationCounter::count() - allocations;
+            double ns = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(o_.ops);
+            if (rep == 0 || ns < best.ns_per_op) {
+                best.ns_per_op = ns;
+                best.allocs_per_op = static_cast<double>(allocations) / static_cast<double>(o_.ops);
+                best.counters = counts;
+            }
+        }
+        results_.push_back(best);
+    }
+
+    // The same stream of payments through three dispatch styles. Types alternate in a random pattern so the
+    // virtual and variant calls see realistic branch prediction; the template case pays each type in its
+    // own loop with the callee known at compile time (the qualified call bypasses the vtable).
+    static constexpr size_t kPayments = 4096;
+
+    void benchDispatch()
+    {
+        std::mt19937_64 rng(11);
+        FlatFeeStrategy flat;
+        PercentFeeStrategy percent;
+        std::vector<const PaymentStrategy *> pointers(kPayments);
+        std::vector<std::variant<FlatFeeStrategy, PercentFeeStrategy>> variants(kPayments);
+        std::vector<double> amounts(kPayments);
+        size_t flat_count = 0;
+        for (size_t i = 0; i < kPayments; ++i) {
+            bool is_flat = rng() & 1;
+            pointers[i] = is_flat ? static_cast<const PaymentStrategy *>(&flat) : &percent;
+            variants[i] = is_flat ? decltype(variants)::value_type(flat) : decltype(variants)::value_type(percent);
+            amounts[i] = static_cast<double>(rng() % 10000) / 100.0;
+            flat_count += is_flat;
+        }
+
+        measure("dispatch/virtual", [&](size_t ops) {
+            size_t approved = 0;
+            for (size_t i = 0; i < ops; ++i) {
+                approved += pointers[i % kPayments]->pay(amounts[i % kPayments]);
+            }
+            doNotOptimize(approved);
+        });
+        measure("dispatch/variant", [&](size_t ops) {
+            size_t approved = 0;
+            for (size_t i = 0; i < ops; ++i) {
+                double amount = amounts[i % kPayments];
+                approved += std::visit(
+                    [amount](const auto &strategy) {
+                        using Strategy = std::decay_t<decltype(strategy)>;
+                        return strategy.Strategy::pay(amount);
+                    },
+                    variants[i % kPayments]);
+            }
+            doNotOptimize(approved);
+        });
+        measure("dispatch/template", [&](size_t ops) {
+            size_t approved = 0;
+            size_t flat_ops = ops * flat_count / kPayments;
+            approved += payAll(flat, amounts, flat_ops);
+            approved += payAll(percent, amounts, ops - flat_ops);
+            doNotOptimize(approved);
+        });
+
+        PaymentContext context;
+        context.setOutput(nullptr);
+        context.setPaymentStrategy(std::make_unique<CreditCardPayment>("1234567890123456", "John Doe", "123"));
+        measure("context/credit-card", [&](size_t ops) {
+            for (size_t i = 0; i < ops; ++i) {
+                context.processPayment(amounts[i % kPayments]);
+            }
+        });
+    }
+    template <typename Strategy>
+    static size_t payAll(const Strategy &strategy, const std::vector<double> &amounts, size_t ops)
+    {
+        size_t approved = 0;
+        for (size_t i = 0; i < ops; ++i) {
+            approved += strategy.Strategy::pay(amounts[i % kPayments]);
+        }
+        return approved;
+    }
+
+    // Replacing the context's strategy: heap-allocated versus the per-thread pool
+    void benchSwap()
+    {
+        PaymentContext context;
+        context.setOutput(nullptr);
+        measure("swap/make_unique", [&](size_t ops) {
+            for (size_t i = 0; i < ops; ++i) {
+                context.setPaymentStrategy(
+                    std::make_unique<CreditCardPayment>("1234567890123456", "John Doe", "123"));
+            }
+        });
+        measure("swap/pool", [&](size_t ops) {
+            for (size_t i = 0; i < ops; ++i) {
+                context.setPaymentStrategy(
+                    StrategyPool::make<CreditCardPayment>("1234567890123456", "John Doe", "123"));
+            }
+        });
+    }
+
+    // The same payments one processPayment() at a time versus processBatch() in groups of 64
+    void benchBatch()
+    {
+        constexpr size_t kBatch = 64;
+        PaymentContext context;
+        context.setOutput(nullptr);
+        context.setPaymentStrategy(std::make_unique<MockGatewayPayment>(std::chrono::microseconds(0), 0.0));
+        std::vector<PaymentRequest> batch(kBatch);
+        for (size_t i = 0; i < kBatch; ++i) {
+            batch[i] = PaymentRequest{i, 10.0 + static_cast<double>(i), 0};
+        }
+        measure("batch/scalar", [&](size_t ops) {
+            for (size_t i = 0; i < ops; ++i) {
+                context.processPayment(batch[i % kBatch].amount, batch[i % kBatch].account);
+            }
+        });
+        measure("batch/batched", [&](size_t ops) {
+            for (size_t i = 0; i < ops; i += kBatch) {
+                doNotOptimize(context.processBatch(batch));
+            }
+        });
+    }
+
+    // Cost of the metrics on the payment path: a trivial strategy called directly, through the fully
+    // instrumented processPayment() (clock reads + record()), and record() alone. The thread first records
+    // into many short-lived contexts, as a server creating one per request would; that must not slow the rest.
+    void benchMetrics()
+    {
+        for (size_t i = 0; i < 50000; ++i) {
+            PaymentContext request;
+            request.setOutput(nullptr);
+            request.setPaymentStrategy(std::make_unique<FlatFeeStrategy>());
+            request.processPayment(1.0);
+        }
+        FlatFeeStrategy strategy;
+        PaymentContext context;
+        context.setOutput(nullptr);
+        context.setPaymentStrategy(std::make_unique<FlatFeeStrategy>());
+        PaymentMetrics metrics;
+        size_t slot = metrics.slotFor("Flat Fee");
+        measure("metrics/direct", [&](size_t ops) {
+            size_t approved = 0;
+            for (size_t i = 0; i < ops; ++i) {
+                approved += strategy.pay(static_cast<double>(i % 1000));
+            }
+            doNotOptimize(approved);
+        });
+        measure("metrics/instrumented", [&](size_t ops) {
+            size_t approved = 0;
+            for (size_t i = 0; i < ops; ++i) {
+                approved += context.processPayment(static_cast<double>(i % 1000));
+            }
+            doNotOptimize(approved);
+        });
+        measure("metrics/record", [&](size_t ops) {
+            for (size_t i = 0; i < ops; ++i) {
+                metrics.record(slot, true, 1.0, std::chrono::nanoseconds(i % 4096));
+            }
+        });
+    }
+
+    const Result *find(const std::string &name) const
+    {
+        for (const Result &r : results_) {
+            if (r.name == name) {
+                return &r;
+            }
+        }
+        return nullptr;
+    }
+
+    void printText(std::ostream &out) const
+    {
+        out << "⏱️ Strategy benchmarks (" << o_.ops << " ops, best of " << o_.repetitions << ")" << std::endl;
+        if (!counters_.available()) {
+            out << "   hardware counters unavailable" << std::endl;
+        }
+        for (const Result &r : results_) {
+            out << "   " << std::left << std::setw(22) << r.name << std::right << std::fixed << std::setprecision(2)
+                << std::setw(9) << r.ns_per_op << " ns/op" << std::setw(7) << r.allocs_per_op << " allocs/op";
+            for (size_t i = 0; i < PerfCounters::kCount; ++i) {
+                if (r.counters[i] >= 0) {
+                    out << "  " << PerfCounters::kNames[i] << " " << perOp(r, i);
+                }
+            }
+            out << std::endl;
+        }
+        const Result *direct = find("metrics/direct"), *instrumented = find("metrics/instrumented");
+        if (direct && instrumented) {
+            out << "   metrics overhead per payment: " << instrumented->ns_per_op - direct->ns_per_op
+                << " ns (budget " << kMetricsBudgetNs << " ns)" << std::endl;
+        }
+    }
+    void printJson(std::ostream &out) const
+    {
+        out << "{\"ops\":" << o_.ops << ",\"repetitions\":" << o_.repetitions
+            << ",\"counters_available\":" << (counters_.available() ? "true" : "false") << ",\"benchmarks\":[";
+        for (size_t r = 0; r < results_.size(); ++r) {
+            const Result &result = results_[r];
+            out << (r ? "," : "") << "{\"name\":\"" << result.name << "\",\"ns_per_op\":" << std::fixed
+                << std::setprecision(3) << result.ns_per_op << ",\"allocs_per_op\":" << result.allocs_per_op;
+            for (size_t i = 0; i < PerfCounters::kCount; ++i) {
+                out << ",\"" << PerfCounters::kNames[i] << "_per_op\":";
+                if (result.counters[i] >= 0) {
+                    out << perOp(result, i);
+                } else {
+                    out << "null";
+                }
+            }
+            out << "}";
+        }
+        out << "]}" << std::endl;
+    }
+    static constexpr double kMetricsBudgetNs = 20.0;
+
+    static double perOp(const Result &r, size_t counter)
+    {
+        return static_cast<double>(r.counters[counter]) / static_cast<double>(r.ops);
+    }
+
+    Options o_;
+    PerfCounters counters_;
+    std::vector<Result> results_;
+};
+
+int runBenchmarks(const std::vector<std::string> &args)
+{
+    StrategyBenchmark::Options options;
+    try {
+        if (!StrategyBenchmark::parse(args, options)) {
+            StrategyBenchmark::usage(std::cerr);
+            return 1;
+        }
+        return StrategyBenchmark(options).run(std::cout);
+    } catch (const std::exception &e) {
+        std::cerr << "❌ " << e.what() << std::endl;
+        StrategyBenchmark::usage(std::cerr);
+        return 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "--loadgen") {
+        return runLoadGenerator(std::vector<std::string>(argv + 2, argv + argc));
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        return runBenchmarks(std::vector<std::string>(argv + 2, argv + argc));
+    }
+
+    std::cout << "💳 Strategy Pattern Example - Payment System" << std::endl;
+    std::cout << std::string(40, '=') << std::endl;
+
+    PaymentContext payment_context;
+    double amount = 120.50;
+
+    std::cout << "💰 Processing payment of $" << std::fixed << std::setprecision(2) << amount << std::endl;
+    std::cout << std::endl;
+
+    // Test Credit Card payment
+    std::cout << "🔄 Using Credit Card:" << std::endl;
+    PaymentDetails details{"1234567890123456", "John Doe", "123", "john.doe@example.com"};
+    payment_context.setPaymentStrategy(StrategyRegistry::create("Credit Card", details));
+    payment_context.processPayment(amount);
+    std::cout << std::endl;
+
+    // Test PayPal payment
+    std::cout << "🔄 Using PayPal:" << std::endl;
+    payment_context.setPaymentStrategy(StrategyRegistry::create("PayPal", details));
+    payment_context.processPayment(amount);
+    std::cout << std::endl;
+
+    // Successful payments land in the ledger
+    auto ledger_dir = std::filesystem::temp_directory_path() / "strategy-ledger";
+    std::filesystem::remove_all(ledger_dir);
+    {
+        PaymentLedger ledger(ledger_dir, 1 << 16);
+        PaymentContext ledger_context;
+        ledger_context.setOutput(nullptr);
+        ledger_context.setLedger(&ledger);
+        ledger_context.setPaymentStrategy(std::make_unique<MockGatewayPayment>(std::chrono::microseconds(0), 0.0));
+        auto since = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+        ledger_context.processPayment(amount);
+        ledger_context.processPayment(30.0);
+        std::cout << "📒 Ledger records:" << std::endl;
+        ledger.scanSince(since, [](const LedgerRecord &record) {
+            std::cout << "   #" << record.transaction_id << " " << record.strategy << " $" << std::fixed
+                      << std::setprecision(2) << record.amount << std::endl;
+        });
+        std::cout << "   bulk: " << measureLedger(ledger, 4, 250000) << std::endl;
+
+        // Settlement file: drops every 1000th payment, changes every 5000th amount, adds one unknown payment
+        // (with an over-long amount field) and one line that is not a record
+        auto settlement = ledger_dir / "settlement.csv";
+        {
+            std::FILE *out = std::fopen(settlement.c_str(), "w");
+            ledger.scan(0, [&](const LedgerRecord &record) {
+                if (record.transaction_id % 1000 != 999) {
+                    double settled = record.transaction_id % 5000 == 7 ? record.amount + 1.0 : record.amount;
+                    std::fprintf(out, "%llu,%.2f\n", static_cast<unsigned long long>(record.transaction_id), settled);
+                }
+            });
+            std::fprintf(out, "%llu,9.99%0200d\n", static_cast<unsigned long long>(ledger.size() + 42), 0);
+            std::fprintf(out, "settlement batch 7 totals follow\n");
+            std::fclose(out);
+        }
+        auto start = std::chrono::steady_clock::now();
+        LedgerReconciler reconciler(ledger_dir / "spill", 64, std::thread::hardware_concurrency());
+        auto report = reconciler.reconcile(ledger, settlement);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "   reconciled " << ledger.size() << " records in " << elapsed.count()
+                  << "ms: matched=" << report.matched << " mismatched=" << report.amount_mismatches
+                  << " missing_in_settlement=" << report.missing_in_settlement
+                  << " missing_in_ledger=" << report.missing_in_ledger << " malformed=" << report.malformed_lines
+                  << std::endl;
+    }
+    {
+        // Segments of 1500 records: the sparse index restarts mid-stride in every segment
+        PaymentLedger unaligned(ledger_dir / "unaligned", 1500);
+        for (uint64_t i = 0; i < 5000; ++i) {
+            unaligned.append(i, 1.0, "Mock Gateway");
+        }
+        int64_t since = 0;
+        uint64_t expected = 0;
+        unaligned.scanRange(3010, 3011, [&](const LedgerRecord &record) { since = record.timestamp_ns; });
+        unaligned.scan(0, [&](const LedgerRecord &record) { expected += record.timestamp_ns >= since; });
+        uint64_t found = 0;
+        unaligned.scanSince(since, [&](const LedgerRecord &) { ++found; });
+        std::cout << "   scanSince over 1500-record segments: " << found << " of " << expected << " records"
+                  << std::endl;
+    }
+    try {
+        PaymentLedger reopened(ledger_dir, 1 << 15);
+        std::cout << "   reopened with half-size segments: " << reopened.size() << " records" << std::endl;
+    } catch (const std::exception &e) {
+        std::cout << "   reopened with half-size segments: refused (" << e.what() << ")" << std::endl;
+    }
+    std::filesystem::remove_all(ledger_dir);
+    std::cout << std::endl;
+
+    // Card tokenization vault
+    {
+        // The key would come from a key store; the snapshot below never contains it
+        const uint64_t vault_key = std::random_device{}() | (static_cast<uint64_t>(std::random_device{}()) << 32);
+        TokenVault vault(vault_key);
+        uint64_t token = vault.tokenize("1234567890123456");
+        std::cout << "🔐 Token vault:" << std::endl;
+        std::cout << "   1234567890123456 -> tok_" << std::hex << token << std::dec << " -> "
+                  << vault.detokenize(token) << std::endl;
+
+        constexpr size_t kTokens = 1000000;
+        vault.reserve(kTokens);
+        std::mt19937_64 rng(7);
+        std::vector<uint64_t> pans(kTokens);
+        for (auto &pan : pans) {
+            pan = 4000000000000000ULL + rng() % 1000000000000000ULL;
+            vault.tokenize(std::to_string(pan));
+        }
+        auto snapshot = std::filesystem::temp_directory_path() / "strategy-tokens.snapshot";
+        vault.save(snapshot);
+        TokenVault restored(vault_key);
+        auto start = std::chrono::steady_clock::now();
+        restored.load(snapshot);
+        auto load_us =
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        uint64_t found = 0;
+        for (size_t i = 0; i < kTokens; ++i) {
+            found += restored.lookup(pans[rng() % kTokens]) != 0;
+        }
+        double lookup_ns =
+            std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / kTokens;
+        std::cout << "   " << restored.size() << " tokens, snapshot mapped in " << load_us << "us, "
+                  << std::setprecision(1) << lookup_ns << "ns/lookup (" << found << " hits)" << std::endl;
+
+        // A snapshot whose card table has no empty control byte is refused rather than hanging lookups
+        {
+            TokenVault small(vault_key);
+            small.tokenize("1234567890123456");
+            small.save(snapshot);
+            std::vector<char> bytes(std::filesystem::file_size(snapshot));
+            std::ifstream(snapshot, std::ios::binary).read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            uint64_t pan_capacity;
+            std::memcpy(&pan_capacity, bytes.data() + 32, sizeof(pan_capacity)); // Header::pan_capacity
+            std::memset(bytes.data() + 64, 0, pan_capacity);                     // every slot marked full
+            std::ofstream(snapshot, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            try {
+                TokenVault(vault_key).load(snapshot);
+                std::cout << "   snapshot without empty slots: loaded" << std::endl;
+            } catch (const std::exception &) {
+                std::cout << "   snapshot without empty slots: refused" << std::endl;
+            }
+        }
+        std::filesystem::remove(snapshot);
+    }
+    std::cout << std::endl;
+
+    // PayPal email canonicalization and batch dedup
+    {
+        std::cout << "📧 PayPal account ids:" << std::endl;
+        std::string canonical;
+        for (std::string_view email : {"John.Doe+shopping@GMail.com", "johndoe@googlemail.com",
+                                       "john.doe@Example.COM", "john..doe@example.com"}) {
+            if (EmailAddress::canonicalize(email, canonical)) {
+                std::cout << "   " << email << " -> " << canonical << " (#" << std::hex
+                          << EmailAddress::accountId(canonical) % 0x10000 << std::dec << ")" << std::endl;
+            } else {
+                std::cout << "   " << email << " -> invalid" << std::endl;
+            }
+        }
+
+        PayPalBatch batch(4);
+        size_t added = 0, duplicates = 0, invalid = 0;
+        for (auto [email, amount] : std::initializer_list<std::pair<std::string_view, double>>{
+                 {"John.Doe+shopping@GMail.com", 25.0},
+                 {"johndoe@gmail.com", 25.0},
+                 {"j.o.h.n.d.o.e@googlemail.com", 30.0},
+                 {"alice@Example.com", 12.5},
+                 {"alice@example.com", 12.5},
+                 {"bob@@example.com", 9.0}}) {
+            auto result = batch.add(email, amount);
+            added += result == PayPalBatch::Result::Added;
+            duplicates += result == PayPalBatch::Result::Duplicate;
+            invalid += result == PayPalBatch::Result::Invalid;
+        }
+        std::cout << "   batch: " << added << " queued, " << duplicates << " duplicates dropped, " << invalid
+                  << " invalid; per shard:";
+        for (size_t i = 0; i < batch.shards(); ++i) {
+            std::cout << " " << batch.shard(i).size();
+        }
+        std::cout << std::endl;
+
+        constexpr size_t kEmails = 1000000;
+        auto start = std::chrono::steady_clock::now();
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < kEmails; ++i) {
+            EmailAddress::canonicalize(i & 1 ? "Customer.Name+receipts@GMail.com" : "customer.name@example.co.uk",
+                                       canonical);
+            checksum += EmailAddress::accountId(canonical);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "   " << std::setprecision(1) << ns / kEmails << "ns/email (checksum " << checksum % 1000 << ")"
+                  << std::endl;
+    }
+    std::cout << std::endl;
+
+    // Fraud screening ahead of the strategy
+    {
+        constexpr size_t kAccounts = 100000;
+        FraudScreen screen(kAccounts, FraudScreen::Weights{});
+        PaymentContext screened;
+        screened.setOutput(nullptr);
+        screened.setFraudScreen(&screen);
+        screened.setPaymentStrategy(StrategyRegistry::create("Mock Gateway", details));
+        screen.setHomeRegion(7, 1);
+        std::vector<PaymentRequest> usual(5, PaymentRequest{7, 40.0, 1});
+        screened.processBatch(usual);
+        auto verdicts = screened.processBatch({{7, 42.0, 1}, {7, 4000.0, 1}, {7, 45.0, 33}});
+        auto verdict = [](bool ok) { return ok ? "approved" : "declined"; };
+        std::cout << "🛡️ Fraud screen: usual $42 " << verdict(verdicts[0]) << ", $4000 " << verdict(verdicts[1])
+                  << ", $45 abroad " << verdict(verdicts[2]) << std::endl;
+        uint64_t paypal_account = PayPalPayment("alice@example.com").accountId(); // hashed onto a feature row
+        std::cout << "   $10 from PayPal account #" << std::hex << paypal_account % 0x10000 << std::dec << ": "
+                  << verdict(screened.processPayment(10.0, paypal_account)) << std::endl;
+
+        std::mt19937_64 rng(11);
+        std::vector<PaymentRequest> batch(FraudScreen::kBatch);
+        std::vector<uint8_t> allowed(batch.size());
+        constexpr size_t kBatches = 4000;
+        std::chrono::nanoseconds elapsed{0};
+        for (size_t b = 0; b < kBatches; ++b) {
+            for (auto &r : batch) {
+                r = {rng() % kAccounts, static_cast<double>(rng() % 20000) / 100.0, static_cast<uint16_t>(rng() % 4)};
+            }
+            std::fill(allowed.begin(), allowed.end(), 1);
+            auto start = std::chrono::steady_clock::now();
+            screen.screen(batch, allowed);
+            elapsed += std::chrono::steady_clock::now() - start;
+        }
+        std::cout << "   scoring: " << std::setprecision(1)
+                  << static_cast<double>(elapsed.count()) / (kBatches * FraudScreen::kBatch)
+                  << "ns/payment at batch size " << FraudScreen::kBatch;
+        uint64_t before = AllocationCounter::count(), allowed_count = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kBatches * FraudScreen::kBatch; ++i) {
+            allowed_count += screen.screenOne(batch[i % batch.size()]);
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << ", " << static_cast<double>(elapsed.count()) / (kBatches * FraudScreen::kBatch)
+                  << "ns/payment one at a time (" << AllocationCounter::count() - before << " allocations, "
+                  << allowed_count << " allowed)" << std::endl;
+    }
+    std::cout << std::endl;
+
+    std::cout << "🧾 Receipts: " << measureReceipts(20000) << std::endl;
+    std::cout << std::endl;
+
+    // Idempotent retries
+    {
+        PaymentContext retry_context;
+        retry_context.setOutput(nullptr);
+        retry_context.setPaymentStrategy(std::make_unique<MockGatewayPayment>(std::chrono::microseconds(2000), 0.0));
+        IdempotentPayments idempotent(retry_context, 16, 100000, std::chrono::milliseconds(50));
+        std::vector<std::thread> retries;
+        for (int i = 0; i < 8; ++i) {
+            retries.emplace_back([&] { idempotent.processPayment("order-1001", amount); });
+        }
+        for (auto &t : retries) {
+            t.join();
+        }
+        idempotent.processPayment("order-1001", amount);
+        std::this_thread::sleep_for(std::chrono::milliseconds(60));
+        idempotent.processPayment("order-1001", amount); // TTL expired: charged again
+        auto stats = idempotent.stats();
+        std::cout << "🔁 Idempotency: 10 submissions of order-1001 -> executed=" << stats.executed
+                  << " coalesced=" << stats.coalesced << " replayed=" << stats.replayed << " (last one after TTL)"
+                  << std::endl;
+    }
+    std::cout << std::endl;
+
+    // Per-request strategies: heap vs per-thread pool
+    {
+        PaymentContext pooled_context;
+        pooled_context.setOutput(nullptr);
+        ReceiptWriter::forThread().flush();
+        ReceiptWriter::setOutput(nullptr);
+        std::cout << "♻️ Strategy allocation, new card strategy per payment:" << std::endl;
+        std::cout << "   make_unique:  " << measureAllocationsPerPayment(pooled_context, 10000, [&] {
+            return std::make_unique<CreditCardPayment>(details.card_number, details.card_holder, details.cvv);
+        }) << std::endl;
+        std::cout << "   StrategyPool: " << measureAllocationsPerPayment(pooled_context, 10000, [&] {
+            return StrategyPool::make<CreditCardPayment>(details.card_number, details.card_holder, details.cvv);
+        }) << std::endl;
+        ReceiptWriter::forThread().flush();
+        ReceiptWriter::setOutput(&std::cout);
+    }
+    std::cout << std::endl;
+
+    // Multi-currency payments settled in USD
+    {
+        FxRateTable rates({1.0, 1.08, 1.27, 0.0067, 0.14});
+        PaymentContext usd_context;
+        usd_context.setOutput(nullptr);
+        usd_context.setPaymentStrategy(StrategyRegistry::create("Mock Gateway", details));
+        CurrencyGateway currency_gateway(rates, usd_context);
+        for (Money price : {Money::fromDecimal(99.99, Currency::EUR), Money::fromDecimal(15000, Currency::JPY)}) {
+            if (auto settled = currency_gateway.pay(price)) {
+                std::cout << "💱 " << price << " settled as " << *settled << std::endl;
+            }
+        }
+
+        std::atomic<bool> stop{false};
+        std::thread publisher([&] {
+            std::mt19937_64 rng(3);
+            std::normal_distribution<double> drift(0.0, 0.0005);
+            FxRateTable::Rates current{1.0, 1.08, 1.27, 0.0067, 0.14};
+            for (auto next = std::chrono::steady_clock::now(); !stop.load(); next += std::chrono::milliseconds(1)) {
+                for (size_t i = 1; i < kCurrencyCount; ++i) {
+                    current[i] *= 1.0 + drift(rng);
+                }
+                rates.publish(current);
+                std::this_thread::sleep_until(next);
+            }
+        });
+        std::atomic<uint64_t> conversions{0}, versions_seen{0};
+        std::atomic<int64_t> converted_minor{0};
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> readers;
+        for (size_t r = 0; r < 2; ++r) {
+            readers.emplace_back([&] {
+                uint64_t local = 0, last_version = 0, distinct = 0;
+                int64_t checksum = 0;
+                Money price = Money::fromDecimal(42.0, Currency::EUR);
+                while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(200)) {
+                    for (int i = 0; i < 1000; ++i) {
+                        checksum += rates.convert(price, Currency::USD).minor;
+                    }
+                    uint64_t version;
+                    rates.rate(price.currency, Currency::USD, &version);
+                    distinct += version != last_version;
+                    last_version = version;
+                    local += 1000;
+                }
+                conversions += local;
+                converted_minor += checksum; // keeps the conversions observable to the optimizer
+                versions_seen = std::max<uint64_t>(versions_seen.load(), distinct);
+            });
+        }
+        for (auto &t : readers) {
+            t.join();
+        }
+        stop = true;
+        publisher.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "   " << static_cast<int64_t>(static_cast<double>(conversions.load()) / seconds)
+                  << " conversions/s while publishing rates at 1kHz (" << versions_seen.load()
+                  << " rate versions observed by one reader)" << std::endl;
+    }
+    std::cout << std::endl;
+
+    // Per-strategy metrics collected by the context
+    std::cout << "📊 Payment metrics:" << std::endl;
+    payment_context.metrics().dumpText(std::cout);
+    std::cout << "   JSON: ";
+    payment_context.metrics().dumpJson(std::cout);
+    std::cout << std::endl << std::endl;
+
+    // Test decorators against a mock gateway with heavy-tailed latency
+    std::cout << "🔄 Hedging a slow gateway:" << std::endl;
+    auto gateway = std::make_shared<MockGatewayPayment>(std::chrono::microseconds(100), 1.2);
+    auto hedged = std::make_shared<HedgedPayment>(gateway, std::chrono::microseconds(500));
+    std::cout << "   direct: " << measureTailLatency(*gateway, 1000) << std::endl;
+    std::cout << "   hedged: " << measureTailLatency(*hedged, 1000) << " (" << hedged->hedgeCount() << " hedges)"
+              << std::endl;
+    std::cout << std::endl;
+
+    std::cout << "🔄 Micro-batching 16 concurrent clients over 2 gateway connections:" << std::endl;
+    auto batch_gateway = std::make_shared<MockGatewayPayment>(std::chrono::microseconds(200), 0.3, 0.0, 2);
+    std::cout << "   unbatched:   " << measureThroughput(*batch_gateway, 16, 50) << std::endl;
+    for (int window_us : {100, 500, 2000}) {
+        BatchingPayment batched(batch_gateway, 64, std::chrono::microseconds(window_us));
+        std::cout << "   window " << std::setw(4) << window_us << "us: " << measureThroughput(batched, 16, 50) << " ("
+                  << batched.batchCount() << " batches)" << std::endl;
+    }
+    {
+        // Batches run on pool workers that in turn wait for hedged attempts queued to the same pool
+        BatchingPayment batched_hedged(hedged, 16, std::chrono::microseconds(500));
+        std::cout << "   hedged, 64 clients: " << measureThroughput(batched_hedged, 64, 20) << " ("
+                  << batched_hedged.batchCount() << " batches)" << std::endl;
+    }
+    std::cout << std::endl;
+
+    std::cout << "🔄 Account-sharded processing:" << std::endl;
+    {
+        ShardedPaymentProcessor processor(2, 4, 100.0, 80.0, [] {
+            return std::make_unique<MockGatewayPayment>(std::chrono::microseconds(0), 0.0);
+        });
+        std::cout << "   pay $50 from #1: " << (processor.pay(1, 50.0).get() ? "ok" : "declined") << std::endl;
+        std::cout << "   pay $90 from #1 (over limit): " << (processor.pay(1, 90.0).get() ? "ok" : "declined")
+                  << std::endl;
+        std::cout << "   transfer $40 #2 -> #3: " << (processor.transfer(2, 3, 40.0).get() ? "committed" : "aborted")
+                  << std::endl;
+        std::cout << "   transfer $40 #2 -> #99 (no such account): "
+                  << (processor.transfer(2, 99, 40.0).get() ? "committed" : "aborted") << std::endl;
+        std::cout << "   transfer -$500 #2 -> #3 (negative): "
+                  << (processor.transfer(2, 3, -500.0).get() ? "committed" : "aborted") << std::endl;
+        std::cout << "   refund $50 to #1: " << (processor.refund(1, 50.0).get() ? "ok" : "declined") << std::endl;
+    }
+    {
+        ShardedPaymentProcessor processor(2, 4, 100.0, 80.0,
+                                          [] { return std::make_unique<UnavailableGatewayPayment>(); });
+        for (uint64_t account : {1, 2}) {
+            try {
+                processor.pay(account, 10.0).get();
+            } catch (const std::exception &e) {
+                std::cout << "   pay $10 from #" << account << " (gateway down): " << e.what() << std::endl;
+            }
+        }
+        std::cout << "   pay $10 from #99 (no such account, gateway down): "
+                  << (processor.pay(99, 10.0).get() ? "ok" : "declined") << std::endl;
+    }
+    ZipfDistribution zipf(10000, 1.1);
+    size_t max_shards = std::min<size_t>(64, std::max<size_t>(4, std::thread::hardware_concurrency()));
+    auto uniform_account = [](std::mt19937_64 &rng) { return rng() % 10000; };
+    auto zipf_account = [&](std::mt19937_64 &rng) { return zipf(rng); };
+    for (size_t shards = 1; shards <= max_shards; shards *= 2) {
+        std::cout << "   " << std::setw(2) << shards << " shards: uniform "
+                  << measureShardedThroughput(shards, 100000, uniform_account) << ", zipf "
+                  << measureShardedThroughput(shards, 100000, zipf_account) << std::endl;
+    }
+    std::cout << std::endl;
+
+    std::cout << "🔄 Split tender (card 2ms + wallet 3ms):" << std::endl;
+    {
+        auto card = std::make_shared<MockGatewayPayment>(std::chrono::microseconds(2000), 0.0);
+        auto wallet = std::make_shared<MockGatewayPayment>(std::chrono::microseconds(3000), 0.0);
+        auto declined = std::make_shared<MockGatewayPayment>(std::chrono::microseconds(3000), 0.0, 1.0);
+        SplitTenderPayment split({{card, 0.7}, {wallet, 0.3}});
+        auto start = std::chrono::steady_clock::now();
+        bool ok = split.pay(amount);
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "   " << split.getName() << ": " << (ok ? "approved" : "declined") << " in " << elapsed.count()
+                  << "us" << std::endl;
+        SplitTenderPayment failing({{card, 0.7}, {declined, 0.3}});
+        ok = failing.pay(amount);
+        std::cout << "   with a declined wallet: " << (ok ? "approved" : "declined") << ", "
+                  << failing.rollbackCount() << " completed part(s) refunded" << std::endl;
+    }
+    std::cout << std::endl;
+
+    std::cout << "🔄 Circuit breaker on a failing gateway:" << std::endl;
+    auto failing = std::make_shared<MockGatewayPayment>(std::chrono::microseconds(50), 0.1, 1.0);
+    CircuitBreakerPayment breaker(failing, 3, std::chrono::milliseconds(50));
+    for (int i = 0; i < 10; ++i) {
+        breaker.pay(amount);
+    }
+    std::cout << "   10 attempts, " << breaker.rejectedCount() << " rejected without calling the gateway" << std::endl;
+    {
+        // A gateway that throws counts as a failure, including the trial call after the cooldown
+        CircuitBreakerPayment down(std::make_shared<UnavailableGatewayPayment>(), 3, std::chrono::milliseconds(20));
+        size_t errors = 0;
+        for (int round = 0; round < 2; ++round) {
+            for (int i = 0; i < 5; ++i) {
+                try {
+                    down.pay(amount);
+                } catch (const std::exception &) {
+                    ++errors;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(25));
+        }
+        std::cout << "   throwing gateway: " << errors << " errors, " << down.rejectedCount()
+                  << " rejected, breaker " << (down.state() == CircuitBreakerPayment::State::Open ? "open" : "not open")
+                  << " after the failed trial" << std::endl;
+    }
     std::cout << std::endl;
 
     std::cout << "✅ Strategy Pattern example completed!" << std::endl;
@@ -117,5 +4386,7 @@ int main()
     std::cout << "  - PaymentStrategy defines the algorithm interface" << std::endl;
     std::cout << "  - CreditCard and PayPal are concrete strategies" << std::endl;
     std::cout << "  - PaymentContext uses payment strategies" << std::endl;
+    std::cout << "  - StrategyRegistry resolves strategies by name via a compile-time perfect hash" << std::endl;
     std::cout << "  - Payment algorithms can be swapped at runtime" << std::endl;
+    std::cout << "  - Decorators (hedging, circuit breaker, batching) wrap any strategy" << std::endl;
 }
@@ -5,13 +5,1349 @@
  * @copyright Copyright (c) 2025 SHAO Liming
  * @license MIT
  *
+ * The builder pattern separates the construction of a complex object from its
+ * representation, so the same construction process can create different
+ * representations.
+ *
  * SPDX-License-Identifier: MIT
  */
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <random>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// AllocationCounter: counts global operator new calls so the example can report allocations per build
+struct AllocationCounter {
+    static inline std::atomic<uint64_t> allocations{0};
+    static uint64_t count() { return allocations.load(std::memory_order_relaxed); }
+};
+
+// Out of line so GCC does not pair an inlined free() with a visible operator new call and warn
+__attribute__((noinline)) void *operator new(std::size_t size)
+{
+    AllocationCounter::allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void *operator new(std::size_t size, std::align_val_t align)
+{
+    AllocationCounter::allocations.fetch_add(1, std::memory_order_relaxed);
+    auto alignment = static_cast<std::size_t>(align);
+    std::size_t rounded = (std::max<std::size_t>(size, 1) + alignment - 1) / alignment * alignment;
+    if (void *p = std::aligned_alloc(alignment, rounded)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+__attribute__((noinline)) void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+__attribute__((noinline)) void operator delete(void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+__attribute__((noinline)) void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+// Product
+struct Computer {
+    std::string cpu;
+    uint32_t ram = 0;     // GB
+    uint32_t storage = 0; // GB
+};
+
+std::ostream &operator<<(std::ostream &out, const Computer &computer)
+{
+    return out << "CPU=" << computer.cpu << ", RAM=" << computer.ram << "GB, Storage=" << computer.storage << "GB";
+}
+
+// ComputerBuilder: fluent builder. On a named builder the setters return a reference and build() copies,
+// so the builder can be reused; on a temporary chain the && overloads pass the builder itself along and
+// build() moves its state out, so the cpu string is moved from the caller into the product, never copied.
+class ComputerBuilder {
+public:
+    ComputerBuilder &setCpu(std::string cpu) &
+    {
+        cpu_ = std::move(cpu);
+        return *this;
+    }
+    ComputerBuilder &&setCpu(std::string cpu) &&
+    {
+        cpu_ = std::move(cpu);
+        return std::move(*this);
+    }
+    ComputerBuilder &setRam(uint32_t ram) &
+    {
+        ram_ = ram;
+        return *this;
+    }
+    ComputerBuilder &&setRam(uint32_t ram) &&
+    {
+        ram_ = ram;
+        return std::move(*this);
+    }
+    ComputerBuilder &setStorage(uint32_t storage) &
+    {
+        storage_ = storage;
+        return *this;
+    }
+    ComputerBuilder &&setStorage(uint32_t storage) &&
+    {
+        storage_ = storage;
+        return std::move(*this);
+    }
+    Computer build() const & { return Computer{cpu_, ram_, storage_}; }
+    Computer build() && { return Computer{std::move(cpu_), ram_, storage_}; }
+
+private:
+    std::string cpu_;
+    uint32_t ram_ = 0, storage_ = 0;
+};
+
+// CopyingComputerBuilder: the same builder with const& setters and a copying build(), for comparison
+class CopyingComputerBuilder {
+public:
+    CopyingComputerBuilder &setCpu(const std::string &cpu)
+    {
+        cpu_ = cpu;
+        return *this;
+    }
+    CopyingComputerBuilder &setRam(uint32_t ram)
+    {
+        ram_ = ram;
+        return *this;
+    }
+    CopyingComputerBuilder &setStorage(uint32_t storage)
+    {
+        storage_ = storage;
+        return *this;
+    }
+    Computer build() const { return Computer{cpu_, ram_, storage_}; }
+
+private:
+    std::string cpu_;
+    uint32_t ram_ = 0, storage_ = 0;
+};
+
+// ArenaComputer: product whose cpu string lives in the batch arena. It is trivially destructible, so a
+// batch is freed by releasing the arena without visiting a single product.
+struct ArenaComputer {
+    std::string_view cpu;
+    uint32_t ram = 0;     // GB
+    uint32_t storage = 0; // GB
+};
+static_assert(std::is_trivially_destructible_v<ArenaComputer>, "arena products are never destroyed one by one");
+
+// ArenaComputerBuilder: bump-allocates strings and products for a whole batch from one
+// std::pmr::monotonic_buffer_resource. Nothing is freed individually; arena.release() drops the batch.
+class ArenaComputerBuilder {
+public:
+    explicit ArenaComputerBuilder(std::pmr::monotonic_buffer_resource &arena) : arena_(arena) {}
+
+    ArenaComputerBuilder &setCpu(std::string_view cpu)
+    {
+        auto *text = static_cast<char *>(arena_.allocate(cpu.size(), 1));
+        std::memcpy(text, cpu.data(), cpu.size());
+        cpu_ = std::string_view(text, cpu.size());
+        return *this;
+    }
+    ArenaComputerBuilder &setRam(uint32_t ram)
+    {
+        ram_ = ram;
+        return *this;
+    }
+    ArenaComputerBuilder &setStorage(uint32_t storage)
+    {
+        storage_ = storage;
+        return *this;
+    }
+    // Valid until the arena is released
+    const ArenaComputer *build()
+    {
+        void *slot = arena_.allocate(sizeof(ArenaComputer), alignof(ArenaComputer));
+        return new (slot) ArenaComputer{cpu_, ram_, storage_};
+    }
+
+private:
+    std::pmr::monotonic_buffer_resource &arena_;
+    std::string_view cpu_;
+    uint32_t ram_ = 0, storage_ = 0;
+};
+
+// ComputerHandle: reference to an interned, immutable Computer. Equal configurations share one
+// instance, so comparing handles is a pointer compare.
+class ComputerHandle {
+public:
+    explicit ComputerHandle(const Computer *computer = nullptr) : computer_(computer) {}
+    const Computer &operator*() const { return *computer_; }
+    const Computer *operator->() const { return computer_; }
+    bool operator==(const ComputerHandle &other) const { return computer_ == other.computer_; }
+    bool operator!=(const ComputerHandle &other) const { return computer_ != other.computer_; }
+
+private:
+    const Computer *computer_;
+};
+
+// ComputerInterner: hash-consing table of Computer instances keyed by a structural hash of all fields.
+// The table is split into shards by hash, each behind a shared_mutex: lookups of existing configurations
+// (the common case) take a shared lock, and only a new configuration takes its shard exclusively.
+// Each shard is an open-addressing array of {hash, instance} slots, so a probe touches one slot and the
+// instance it points to. Instances live as long as the interner.
+class ComputerInterner {
+public:
+    static constexpr size_t kShards = 64;
+
+    ComputerHandle intern(std::string_view cpu, uint32_t ram, uint32_t storage)
+    {
+        uint64_t hash = structuralHash(cpu, ram, storage);
+        Shard &shard = shards_[hash % kShards];
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            if (const Computer *found = find(shard, hash, cpu, ram, storage)) {
+                return ComputerHandle(found);
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        if (const Computer *found = find(shard, hash, cpu, ram, storage)) { // another thread won the race
+            return ComputerHandle(found);
+        }
+        if ((shard.instances.size() + 1) * 4 > shard.slots.size() * 3) {
+            grow(shard);
+        }
+        shard.instances.push_back(std::make_unique<const Computer>(Computer{std::string(cpu), ram, storage}));
+        const Computer *computer = shard.instances.back().get();
+        place(shard, Slot{hash, computer});
+        return ComputerHandle(computer);
+    }
+    size_t size() const
+    {
+        size_t total = 0;
+        for (const Shard &shard : shards_) {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            total += shard.instances.size();
+        }
+        return total;
+    }
+
+    // FNV-1a over the cpu name, then the numeric fields folded in with a splitmix finalizer
+    static uint64_t structuralHash(std::string_view cpu, uint32_t ram, uint32_t storage)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (char c : cpu) {
+            h = (h ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+        }
+        h ^= (static_cast<uint64_t>(ram) << 32 | storage) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+
+private:
+    struct Slot {
+        uint64_t hash;
+        const Computer *computer; // nullptr marks an empty slot
+    };
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::vector<Slot> slots = std::vector<Slot>(16, Slot{0, nullptr});
+        std::vector<std::unique_ptr<const Computer>> instances;
+    };
+
+    // The shard index came from hash % kShards, so slots are picked with the bits above it
+    static size_t home(const Shard &shard, uint64_t hash) { return (hash / kShards) & (shard.slots.size() - 1); }
+    static const Computer *find(const Shard &shard, uint64_t hash, std::string_view cpu, uint32_t ram,
+                                uint32_t storage)
+    {
+        size_t mask = shard.slots.size() - 1;
+        for (size_t i = home(shard, hash);; i = (i + 1) & mask) {
+            const Slot &slot = shard.slots[i];
+            if (!slot.computer) {
+                return nullptr;
+            }
+            if (slot.hash == hash && slot.computer->ram == ram && slot.computer->storage == storage &&
+                slot.computer->cpu == cpu) {
+                return slot.computer;
+            }
+        }
+    }
+    static void place(Shard &shard, Slot slot)
+    {
+        size_t mask = shard.slots.size() - 1;
+        size_t i = home(shard, slot.hash);
+        while (shard.slots[i].computer) {
+            i = (i + 1) & mask;
+        }
+        shard.slots[i] = slot;
+    }
+    static void grow(Shard &shard)
+    {
+        std::vector<Slot> old(shard.slots.size() * 2, Slot{0, nullptr});
+        old.swap(shard.slots);
+        for (const Slot &slot : old) {
+            if (slot.computer) {
+                place(shard, slot);
+            }
+        }
+    }
+
+    std::array<Shard, kShards> shards_;
+};
+
+// InterningComputerBuilder: fluent builder whose build() returns the shared instance for the configuration.
+// Setters only record views, so building a configuration that already exists allocates nothing.
+class InterningComputerBuilder {
+public:
+    explicit InterningComputerBuilder(ComputerInterner &interner) : interner_(interner) {}
+
+    InterningComputerBuilder &setCpu(std::string_view cpu)
+    {
+        cpu_ = cpu;
+        return *this;
+    }
+    InterningComputerBuilder &setRam(uint32_t ram)
+    {
+        ram_ = ram;
+        return *this;
+    }
+    InterningComputerBuilder &setStorage(uint32_t storage)
+    {
+        storage_ = storage;
+        return *this;
+    }
+    ComputerHandle build() const { return interner_.intern(cpu_, ram_, storage_); }
+
+private:
+    ComputerInterner &interner_;
+    std::string_view cpu_;
+    uint32_t ram_ = 0, storage_ = 0;
+};
+
+// Fields a TypedComputerBuilder has set, as bits of its template argument
+enum ComputerField : unsigned { kCpuField = 1, kRamField = 2, kStorageField = 4, kAllFields = 7 };
+
+// TypedComputerBuilder: typestate builder. Which fields are set is part of the type: each setter returns
+// the builder type for the next state, and build() only exists once every field is set, so a missing
+// field is a compile error. Nothing is tracked at run time; the chain inlines to constructing Computer.
+template <unsigned Fields = 0>
+class TypedComputerBuilder {
+public:
+    TypedComputerBuilder() = default;
+
+    TypedComputerBuilder<Fields | kCpuField> setCpu(std::string cpu) &&
+    {
+        return {std::move(cpu), ram_, storage_};
+    }
+    TypedComputerBuilder<Fields | kRamField> setRam(uint32_t ram) && { return {std::move(cpu_), ram, storage_}; }
+    TypedComputerBuilder<Fields | kStorageField> setStorage(uint32_t storage) &&
+    {
+        return {std::move(cpu_), ram_, storage};
+    }
+    template <unsigned Set = Fields, typename = std::enable_if_t<Set == kAllFields>>
+    Computer build() &&
+    {
+        return Computer{std::move(cpu_), ram_, storage_};
+    }
+
+private:
+    template <unsigned>
+    friend class TypedComputerBuilder;
+
+    TypedComputerBuilder(std::string cpu, uint32_t ram, uint32_t storage)
+        : cpu_(std::move(cpu)), ram_(ram), storage_(storage)
+    {
+    }
+
+    std::string cpu_;
+    uint32_t ram_ = 0, storage_ = 0;
+};
+
+// Compile-time checks: build() is only callable with every field set, and the state costs no storage
+template <typename Builder, typename = void>
+struct CanBuild : std::false_type {};
+template <typename Builder>
+struct CanBuild<Builder, std::void_t<decltype(std::declval<Builder>().build())>> : std::true_type {};
+
+static_assert(CanBuild<TypedComputerBuilder<kAllFields>>::value, "all fields set: build() must compile");
+static_assert(!CanBuild<TypedComputerBuilder<kCpuField | kRamField>>::value, "storage missing: no build()");
+static_assert(!CanBuild<TypedComputerBuilder<>>::value, "nothing set: no build()");
+static_assert(sizeof(TypedComputerBuilder<>) == sizeof(Computer), "typestate adds no runtime fields");
+
+// ComputerSpec: literal-type product for compile-time catalogs; cpu refers to a string literal
+struct ComputerSpec {
+    std::string_view cpu;
+    uint32_t ram = 0;     // GB
+    uint32_t storage = 0; // GB
+
+    Computer toComputer() const { return Computer{std::string(cpu), ram, storage}; }
+};
+
+// SpecBuilder: constexpr builder. Setters return an updated copy, so whole chains (and the Director
+// recipes that use them) run in constant expressions and catalogs become read-only data.
+class SpecBuilder {
+public:
+    constexpr SpecBuilder setCpu(std::string_view cpu) const
+    {
+        SpecBuilder next = *this;
+        next.spec_.cpu = cpu;
+        return next;
+    }
+    constexpr SpecBuilder setRam(uint32_t ram) const
+    {
+        SpecBuilder next = *this;
+        next.spec_.ram = ram;
+        return next;
+    }
+    constexpr SpecBuilder setStorage(uint32_t storage) const
+    {
+        SpecBuilder next = *this;
+        next.spec_.storage = storage;
+        return next;
+    }
+    constexpr ComputerSpec build() const { return spec_; }
+
+private:
+    ComputerSpec spec_{};
+};
+
+// Director
+class Director {
+public:
+    static Computer constructGamingPc(ComputerBuilder &builder)
+    {
+        return builder.setCpu("Intel i9").setRam(32).setStorage(2000).build();
+    }
+    static Computer constructGamingPc(ComputerBuilder &&builder)
+    {
+        return std::move(builder).setCpu("Intel i9").setRam(32).setStorage(2000).build();
+    }
+    static constexpr ComputerSpec constructGamingPc(SpecBuilder builder)
+    {
+        return builder.setCpu("Intel i9").setRam(32).setStorage(2000).build();
+    }
+    // One recipe for both builders: a ComputerBuilder yields a Computer, a SpecBuilder a constexpr ComputerSpec
+    template <typename Builder>
+    static constexpr auto constructWorkstation(Builder &&builder)
+    {
+        return std::forward<Builder>(builder)
+            .setCpu("AMD Threadripper PRO 7995WX")
+            .setRam(256)
+            .setStorage(8000)
+            .build();
+    }
+    template <typename Builder>
+    static constexpr auto constructOfficePc(Builder &&builder)
+    {
+        return std::forward<Builder>(builder).setCpu("Intel Core i5-14400").setRam(16).setStorage(512).build();
+    }
+};
+
+// Compile-time catalog: the named recipes followed by every CPU x RAM x storage combination
+constexpr std::array<std::string_view, 4> kCatalogCpus{"Intel Core i9-14900K", "AMD Ryzen 9 7950X3D",
+                                                       "Apple M3 Max 16-core", "Intel Xeon w9-3495X"};
+constexpr std::array<uint32_t, 4> kCatalogRam{16, 32, 64, 128};
+constexpr std::array<uint32_t, 4> kCatalogStorage{512, 1000, 2000, 4000};
+constexpr size_t kCatalogSize = 3 + kCatalogCpus.size() * kCatalogRam.size() * kCatalogStorage.size();
+
+// Passes every catalog product, built with Builder, to sink in catalog order. Both the constexpr catalog
+// and the one built at run time come from here, so they cannot drift apart.
+template <typename Builder, typename Sink>
+constexpr void buildCatalog(Sink sink)
+{
+    sink(Director::constructGamingPc(Builder()));
+    sink(Director::constructWorkstation(Builder()));
+    sink(Director::constructOfficePc(Builder()));
+    for (std::string_view cpu : kCatalogCpus) {
+        for (uint32_t ram : kCatalogRam) {
+            for (uint32_t storage : kCatalogStorage) {
+                if constexpr (std::is_same_v<Builder, SpecBuilder>) {
+                    sink(Builder().setCpu(cpu).setRam(ram).setStorage(storage).build());
+                } else {
+                    sink(Builder().setCpu(std::string(cpu)).setRam(ram).setStorage(storage).build());
+                }
+            }
+        }
+    }
+}
+
+constexpr std::array<ComputerSpec, kCatalogSize> makeCatalog()
+{
+    std::array<ComputerSpec, kCatalogSize> catalog{};
+    size_t next = 0;
+    buildCatalog<SpecBuilder>([&](const ComputerSpec &spec) { catalog[next++] = spec; });
+    return catalog;
+}
+constexpr std::array<ComputerSpec, kCatalogSize> kCatalog = makeCatalog();
+
+static_assert(kCatalog[0].cpu == "Intel i9" && kCatalog[0].ram == 32 && kCatalog[0].storage == 2000,
+              "gaming PC recipe evaluated at compile time");
+static_assert(kCatalog[1].ram == 256 && kCatalog[2].storage == 512, "director recipes evaluated at compile time");
+static_assert(kCatalog[kCatalogSize - 1].cpu == "Intel Xeon w9-3495X" && kCatalog[kCatalogSize - 1].ram == 128 &&
+                  kCatalog[kCatalogSize - 1].storage == 4000,
+              "combinations generated at compile time");
+
+// ThreadPool: fixed set of workers draining one task queue. A task is told the index of the worker
+// running it, so it can use per-worker state without locking.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads)
+    {
+        for (size_t worker = 0; worker < threads; ++worker) {
+            workers_.emplace_back([this, worker] { run(worker); });
+        }
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+    }
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const { return workers_.size(); }
+    std::future<void> submit(std::function<void(size_t worker)> task)
+    {
+        auto packaged = std::make_shared<std::packaged_task<void(size_t)>>(std::move(task));
+        std::future<void> done = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push([packaged](size_t worker) { (*packaged)(worker); });
+        }
+        cv_.notify_one();
+        return done;
+    }
+
+private:
+    void run(size_t worker)
+    {
+        for (;;) {
+            std::function<void(size_t)> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task(worker);
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void(size_t)>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+};
+
+// ProductCatalog: products built by ParallelDirector. products[i] is built from recipe i and lives in
+// the arena of whichever worker built it; destroying the catalog releases every arena at once.
+struct ProductCatalog {
+    std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> arenas; // one per worker
+    std::vector<const ArenaComputer *> products;
+};
+
+// ParallelDirector: builds a catalog of recipes on a thread pool. Recipes are split into fixed-size chunks;
+// each worker builds its chunks with its own ArenaComputerBuilder into its own arena and writes a disjoint
+// range of the output, so workers share no mutable state beyond the pool's queue.
+class ParallelDirector {
+public:
+    static constexpr size_t kChunk = 1 << 16;
+
+    explicit ParallelDirector(ThreadPool &pool) : pool_(pool) {}
+
+    ProductCatalog construct(const std::vector<ComputerSpec> &recipes) const
+    {
+        ProductCatalog catalog;
+        catalog.products.resize(recipes.size());
+        for (size_t worker = 0; worker < pool_.size(); ++worker) {
+            catalog.arenas.push_back(std::make_unique<std::pmr::monotonic_buffer_resource>(1 << 20));
+        }
+        std::vector<std::future<void>> chunks;
+        std::exception_ptr submit_error;
+        try {
+            for (size_t begin = 0; begin < recipes.size(); begin += kChunk) {
+                size_t end = std::min(begin + kChunk, recipes.size());
+                chunks.push_back(pool_.submit([&, begin, end](size_t worker) {
+                    ArenaComputerBuilder builder(*catalog.arenas[worker]);
+                    for (size_t i = begin; i < end; ++i) {
+                        const ComputerSpec &recipe = recipes[i];
+                        catalog.products[i] =
+                            builder.setCpu(recipe.cpu).setRam(recipe.ram).setStorage(recipe.storage).build();
+                    }
+                }));
+            }
+        } catch (...) {
+            submit_error = std::current_exception();
+        }
+        // Chunks refer to catalog and recipes, so every one must finish before an exception unwinds them
+        for (auto &chunk : chunks) {
+            chunk.wait();
+        }
+        if (submit_error) {
+            std::rethrow_exception(submit_error);
+        }
+        for (auto &chunk : chunks) {
+            chunk.get(); // rethrows the first chunk's exception
+        }
+        return catalog;
+    }
+
+private:
+    ThreadPool &pool_;
+};
+
+// ComputerConfigFile: memory-maps a text file with one "cpu,ram,storage" spec per line and feeds each line
+// to SpecBuilder. The file is split into chunks at line boundaries that are parsed on separate threads;
+// delimiters are found 8 bytes at a time with SWAR compares. Specs view their cpu name in the mapping,
+// so no input is copied, and they stay valid while the file object lives.
+class ComputerConfigFile {
+public:
+    explicit ComputerConfigFile(const std::filesystem::path &path) : bytes_(std::filesystem::file_size(path))
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("cannot open config " + path.string());
+        }
+        void *mapped = bytes_ ? ::mmap(nullptr, bytes_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0) : nullptr;
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("cannot map config " + path.string());
+        }
+        data_ = static_cast<const char *>(mapped);
+    }
+    ~ComputerConfigFile()
+    {
+        if (data_) {
+            ::munmap(const_cast<char *>(data_), bytes_);
+        }
+    }
+    ComputerConfigFile(const ComputerConfigFile &) = delete;
+    ComputerConfigFile &operator=(const ComputerConfigFile &) = delete;
+
+    size_t bytes() const { return bytes_; }
+    // Malformed lines (wrong field count, non-numeric ram/storage) are skipped and counted
+    std::vector<ComputerSpec> parse(size_t threads, size_t *skipped = nullptr) const
+    {
+        threads = std::max<size_t>(1, std::min(threads, bytes_ / kMinChunk + 1));
+        std::vector<std::vector<ComputerSpec>> parts(threads);
+        std::vector<size_t> skips(threads, 0);
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                const char *begin = lineStart(bytes_ * t / threads), *end = lineStart(bytes_ * (t + 1) / threads);
+                parts[t].reserve(static_cast<size_t>(end - begin) / 24);
+                skips[t] = parseChunk(begin, end, parts[t]);
+            });
+        }
+        size_t total = 0;
+        for (size_t t = 0; t < threads; ++t) {
+            workers[t].join();
+            total += parts[t].size();
+            if (skipped) {
+                *skipped += skips[t];
+            }
+        }
+        if (threads == 1) {
+            return std::move(parts[0]);
+        }
+        std::vector<ComputerSpec> specs;
+        specs.reserve(total);
+        for (auto &part : parts) {
+            specs.insert(specs.end(), part.begin(), part.end());
+        }
+        return specs;
+    }
+
+private:
+    static constexpr size_t kMinChunk = 1 << 20;
+    static constexpr uint64_t kLowBits = 0x0101010101010101ULL;
+    static constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+
+    // First line that starts at or after offset; chunks [lineStart(a), lineStart(b)) tile the file
+    const char *lineStart(size_t offset) const
+    {
+        if (offset == 0 || offset >= bytes_) {
+            return data_ + (offset == 0 ? 0 : bytes_);
+        }
+        const void *newline = std::memchr(data_ + offset - 1, '\n', bytes_ - offset + 1);
+        return newline ? static_cast<const char *>(newline) + 1 : data_ + bytes_;
+    }
+    // High bit set in every byte equal to c
+    static uint64_t equal(uint64_t word, uint8_t c)
+    {
+        uint64_t x = word ^ (kLowBits * c);
+        return ~(((x & ~kHighBits) + ~kHighBits) | x) & kHighBits;
+    }
+    static bool parseNumber(const char *begin, const char *end, uint32_t &value)
+    {
+        if (begin == end || end - begin > 9) {
+            return false;
+        }
+        value = 0;
+        for (const char *p = begin; p < end; ++p) {
+            if (*p < '0' || *p > '9') {
+                return false;
+            }
+            value = value * 10 + static_cast<uint32_t>(*p - '0');
+        }
+        return true;
+    }
+    static size_t parseChunk(const char *begin, const char *end, std::vector<ComputerSpec> &out)
+    {
+        size_t skipped = 0, fields = 0;
+        const char *line = begin, *cpu_end = begin, *ram_end = begin;
+        auto endLine = [&](const char *line_end) {
+            if (line_end > line && line_end[-1] == '\r') {
+                --line_end;
+            }
+            uint32_t ram, storage;
+            if (fields == 2 && parseNumber(cpu_end + 1, ram_end, ram) && parseNumber(ram_end + 1, line_end, storage)) {
+                out.push_back(SpecBuilder()
+                                  .setCpu(std::string_view(line, static_cast<size_t>(cpu_end - line)))
+                                  .setRam(ram)
+                                  .setStorage(storage)
+                                  .build());
+            } else if (fields != 0 || line_end != line) { // blank lines are not errors
+                ++skipped;
+            }
+            fields = 0;
+        };
+        auto delimiter = [&](const char *d) {
+            if (*d == '\n') {
+                endLine(d);
+                line = d + 1;
+            } else if (++fields == 1) {
+                cpu_end = d;
+            } else if (fields == 2) {
+                ram_end = d;
+            }
+        };
+
+        for (const char *p = begin; p < end; p += 8) {
+            uint64_t word = 0; // a short final word is zero-padded, and zero is not a delimiter
+            if (end - p >= 8) {
+                std::memcpy(&word, p, 8);
+            } else {
+                std::memcpy(&word, p, static_cast<size_t>(end - p));
+            }
+            for (uint64_t m = equal(word, ',') | equal(word, '\n'); m; m &= m - 1) {
+                delimiter(p + (__builtin_ctzll(m) >> 3));
+            }
+        }
+        if (line < end) { // last line without a newline
+            endLine(end);
+        }
+        return skipped;
+    }
+
+    size_t bytes_;
+    const char *data_ = nullptr;
+};
+
+// Flat binary form of Computer products, FlatBuffers-style: fixed-size records that refer to their cpu
+// name by offset into a string section, so a mapped file is read in place. Little-endian, no pointers:
+//   header | record[count] | strings
+struct FlatHeader {
+    char magic[8];
+    uint32_t version, count;
+    uint64_t records_offset, strings_offset, strings_bytes;
+};
+struct FlatRecord {
+    uint32_t cpu_offset, cpu_length; // within the string section
+    uint32_t ram, storage;
+};
+static_assert(sizeof(FlatHeader) == 40 && sizeof(FlatRecord) == 16, "flat layout is part of the file format");
+
+// FlatComputerWriter: builder that appends each product to the flat form instead of materializing it.
+// Identical cpu names are stored once.
+class FlatComputerWriter {
+public:
+    FlatComputerWriter &setCpu(std::string_view cpu)
+    {
+        auto [it, inserted] = string_offsets_.try_emplace(std::string(cpu), static_cast<uint32_t>(strings_.size()));
+        if (inserted) {
+            strings_.append(cpu);
+        }
+        record_.cpu_offset = it->second;
+        record_.cpu_length = static_cast<uint32_t>(cpu.size());
+        return *this;
+    }
+    FlatComputerWriter &setRam(uint32_t ram)
+    {
+        record_.ram = ram;
+        return *this;
+    }
+    FlatComputerWriter &setStorage(uint32_t storage)
+    {
+        record_.storage = storage;
+        return *this;
+    }
+    void build() { records_.push_back(record_); }
+
+    void save(const std::filesystem::path &path) const
+    {
+        FlatHeader header{{'C', 'O', 'M', 'P', 'F', 'L', 'A', 'T'}, 1, static_cast<uint32_t>(records_.size()),
+                          sizeof(FlatHeader), sizeof(FlatHeader) + records_.size() * sizeof(FlatRecord),
+                          strings_.size()};
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(records_.data()),
+                   static_cast<std::streamsize>(records_.size() * sizeof(FlatRecord)));
+        file.write(strings_.data(), static_cast<std::streamsize>(strings_.size()));
+        if (!file) {
+            throw std::runtime_error("cannot write flat products " + path.string());
+        }
+    }
+
+private:
+    FlatRecord record_{};
+    std::vector<FlatRecord> records_;
+    std::string strings_;
+    std::unordered_map<std::string, uint32_t> string_offsets_;
+};
+
+// FlatComputerView: one product read in place from the mapping
+class FlatComputerView {
+public:
+    FlatComputerView(const FlatRecord *record, const char *strings) : record_(record), strings_(strings) {}
+    std::string_view cpu() const { return std::string_view(strings_ + record_->cpu_offset, record_->cpu_length); }
+    uint32_t ram() const { return record_->ram; }
+    uint32_t storage() const { return record_->storage; }
+    Computer toComputer() const { return Computer{std::string(cpu()), ram(), storage()}; }
+
+private:
+    const FlatRecord *record_;
+    const char *strings_;
+};
+
+// FlatComputerFile: maps a flat product file and reads fields directly, with no deserialization. Opening
+// checks only the header, so the first access costs O(1); call verify() before trusting a file from
+// elsewhere, which checks that every record's name lies inside the string section.
+class FlatComputerFile {
+public:
+    explicit FlatComputerFile(const std::filesystem::path &path) : bytes_(std::filesystem::file_size(path))
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("cannot open flat products " + path.string());
+        }
+        void *mapped = ::mmap(nullptr, bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("cannot map flat products " + path.string());
+        }
+        base_ = static_cast<const char *>(mapped);
+        FlatHeader header;
+        std::memcpy(&header, base_, std::min(bytes_, sizeof(header)));
+        // Each bound is checked against the remaining size, never as a sum that could wrap around
+        bool valid = bytes_ >= sizeof(header) && std::memcmp(header.magic, "COMPFLAT", 8) == 0 &&
+                     header.version == 1 && header.records_offset == sizeof(header) &&
+                     header.count <= (bytes_ - header.records_offset) / sizeof(FlatRecord) &&
+                     header.strings_offset == header.records_offset + uint64_t{header.count} * sizeof(FlatRecord) &&
+                     header.strings_bytes == bytes_ - header.strings_offset;
+        records_ = reinterpret_cast<const FlatRecord *>(base_ + sizeof(header));
+        strings_ = base_ + header.strings_offset;
+        strings_bytes_ = header.strings_bytes;
+        count_ = header.count;
+        if (!valid) {
+            ::munmap(const_cast<char *>(base_), bytes_);
+            throw std::runtime_error("not a flat product file: " + path.string());
+        }
+    }
+    ~FlatComputerFile() { ::munmap(const_cast<char *>(base_), bytes_); }
+    FlatComputerFile(const FlatComputerFile &) = delete;
+    FlatComputerFile &operator=(const FlatComputerFile &) = delete;
+
+    bool verify() const
+    {
+        for (size_t i = 0; i < count_; ++i) {
+            if (uint64_t{records_[i].cpu_offset} + records_[i].cpu_length > strings_bytes_) {
+                return false;
+            }
+        }
+        return true;
+    }
+    size_t size() const { return count_; }
+    size_t bytes() const { return bytes_; }
+    FlatComputerView operator[](size_t index) const { return FlatComputerView(records_ + index, strings_); }
+
+private:
+    size_t bytes_;
+    const char *base_ = nullptr;
+    const FlatRecord *records_ = nullptr;
+    const char *strings_ = nullptr;
+    uint64_t strings_bytes_ = 0;
+    size_t count_ = 0;
+};
+
+// The same catalog built at run time with ComputerBuilder, as a startup routine would without constexpr
+std::vector<Computer> buildRuntimeCatalog()
+{
+    std::vector<Computer> catalog;
+    catalog.reserve(kCatalogSize);
+    buildCatalog<ComputerBuilder>([&](Computer computer) { catalog.push_back(std::move(computer)); });
+    return catalog;
+}
+
+// CPU models long enough to defeat the small-string optimization, so every string copy allocates
+constexpr std::array<const char *, 4> kCpuModels{"Intel Core i9-14900K", "AMD Ryzen 9 7950X3D", "Apple M3 Max 16-core",
+                                                 "Intel Xeon w9-3495X"};
+
+// Builds computers one temporary chain at a time; formats allocations and nanoseconds per build
+template <typename Build>
+std::string measureBuilds(size_t builds, Build build)
+{
+    std::vector<Computer> computers;
+    computers.reserve(builds);
+    uint64_t before = AllocationCounter::count();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < builds; ++i) {
+        computers.push_back(build(std::string(kCpuModels[i % kCpuModels.size()]), static_cast<uint32_t>(i % 128)));
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    double allocations = static_cast<double>(AllocationCounter::count() - before);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << allocations / static_cast<double>(builds) << " allocations/build, "
+        << std::setprecision(1) << ns / static_cast<double>(builds) << "ns/build";
+    return out.str();
+}
+
+// Peak resident set size of the process in KiB (VmHWM); resetPeakRss() restarts it from the current RSS
+long peakRssKb()
+{
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::stol(line.substr(6));
+        }
+    }
+    return -1;
+}
+void resetPeakRss()
+{
+#if defined(__GLIBC__)
+    malloc_trim(0); // hand memory freed by the previous batch back, so it is not reused invisibly
+#endif
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+// Builds and frees one batch of products, once with a heap object and std::string per product and
+// once from an arena; formats products/s, allocations/product and the batch's peak RSS for each
+std::string measureBatch(size_t products, bool use_arena)
+{
+    resetPeakRss();
+    long rss_before = peakRssKb();
+    uint64_t allocations = AllocationCounter::count();
+    auto start = std::chrono::steady_clock::now();
+    if (use_arena) {
+        std::pmr::monotonic_buffer_resource arena(1 << 20);
+        ArenaComputerBuilder builder(arena);
+        std::vector<const ArenaComputer *> batch(products);
+        for (size_t i = 0; i < products; ++i) {
+            batch[i] = builder.setCpu(kCatalogCpus[i % kCatalogCpus.size()])
+                           .setRam(kCatalogRam[i % kCatalogRam.size()])
+                           .setStorage(kCatalogStorage[i % kCatalogStorage.size()])
+                           .build();
+        }
+        arena.release(); // the whole batch in one call
+    } else {
+        std::vector<std::unique_ptr<Computer>> batch(products);
+        for (size_t i = 0; i < products; ++i) {
+            batch[i] = std::make_unique<Computer>(ComputerBuilder()
+                                                      .setCpu(std::string(kCatalogCpus[i % kCatalogCpus.size()]))
+                                                      .setRam(kCatalogRam[i % kCatalogRam.size()])
+                                                      .setStorage(kCatalogStorage[i % kCatalogStorage.size()])
+                                                      .build());
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    allocations = AllocationCounter::count() - allocations;
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << products / seconds / 1e6 << "M products/s, " << std::setprecision(2)
+        << static_cast<double>(allocations) / static_cast<double>(products) << " allocations/product, peak RSS +"
+        << (peakRssKb() - rss_before) / 1024 << "MiB";
+    return out.str();
+}
+
+// Builds products drawn from a Zipf(1.1) distribution over distinct configurations on every core, as
+// plain Computer values or as interned handles; formats ns/build, allocations/build and peak RSS
+std::string measureInterning(size_t products, size_t configurations, bool intern)
+{
+    std::vector<double> cdf(configurations);
+    double total = 0.0;
+    for (size_t k = 0; k < configurations; ++k) {
+        cdf[k] = total += 1.0 / std::pow(static_cast<double>(k + 1), 1.1);
+    }
+    std::mt19937_64 rng(42);
+    std::vector<uint32_t> picks(products);
+    for (auto &pick : picks) {
+        double u = std::uniform_real_distribution<double>(0.0, total)(rng);
+        pick = static_cast<uint32_t>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+    }
+    // Configuration k: cycles through the CPU names, with RAM and storage derived from k
+    auto cpu = [](uint32_t k) { return kCatalogCpus[k % kCatalogCpus.size()]; };
+    auto ram = [](uint32_t k) { return 8 * (1 + k / 4 % 64); };
+    auto storage = [](uint32_t k) { return 256 * (1 + k / 256); };
+
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    auto slice = [&](size_t t) { return std::make_pair(products * t / threads, products * (t + 1) / threads); };
+    std::vector<Computer> values;
+    std::vector<ComputerHandle> handles;
+    ComputerInterner interner;
+
+    resetPeakRss();
+    long rss_before = peakRssKb();
+    uint64_t allocations = AllocationCounter::count();
+    auto start = std::chrono::steady_clock::now();
+    (intern ? handles.resize(products) : values.resize(products));
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            auto [begin, end] = slice(t);
+            InterningComputerBuilder builder(interner);
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t k = picks[i];
+                if (intern) {
+                    handles[i] = builder.setCpu(cpu(k)).setRam(ram(k)).setStorage(storage(k)).build();
+                } else {
+                    values[i] =
+                        ComputerBuilder().setCpu(std::string(cpu(k))).setRam(ram(k)).setStorage(storage(k)).build();
+                }
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    allocations = AllocationCounter::count() - allocations;
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << ns / static_cast<double>(products) << "ns/build, "
+        << std::setprecision(2) << static_cast<double>(allocations) / static_cast<double>(products)
+        << " allocations/build, peak RSS +" << (peakRssKb() - rss_before) / 1024 << "MiB";
+    if (intern) {
+        out << ", " << interner.size() << " distinct";
+    }
+    return out.str();
+}
+
+// Writes lines specs (plus a few malformed ones) to a temporary file, maps it and parses it on 1 and on all
+// cores; prints throughput for each
+void measureConfigParsing(size_t lines)
+{
+    auto path = std::filesystem::temp_directory_path() / "builder-computers.csv";
+    {
+        std::ofstream file(path, std::ios::binary);
+        for (size_t i = 0; i < lines; ++i) {
+            file << kCatalogCpus[i % kCatalogCpus.size()] << ',' << kCatalogRam[i / 4 % kCatalogRam.size()] << ','
+                 << kCatalogStorage[i / 16 % kCatalogStorage.size()] << '\n';
+        }
+        file << "not a spec\n" << "Intel i9,32\n" << "Intel i9,lots,2000\n" << "\n" << "Intel i9,32,2000";
+    }
+    auto start = std::chrono::steady_clock::now();
+    ComputerConfigFile config(path);
+    auto map_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "📄 Parsing " << lines + 1 << " specs (" << config.bytes() / (1 << 20) << "MiB, mapped in "
+              << std::fixed << std::setprecision(1) << map_ms << "ms):" << std::endl;
+
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads : {size_t{1}, cores}) {
+        size_t skipped = 0;
+        start = std::chrono::steady_clock::now();
+        std::vector<ComputerSpec> specs = config.parse(threads, &skipped);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "   " << threads << " thread(s): " << std::setprecision(2) << config.bytes() / seconds / 1e9
+                  << " GB/s, " << specs.size() << " specs, " << skipped << " malformed lines skipped, last: "
+                  << specs.back().toComputer() << std::endl;
+        if (threads == cores) {
+            break;
+        }
+    }
+    std::filesystem::remove(path);
+}
+
+// Writes the same products as text and in flat form, then compares opening each and reading one product
+// (text must be parsed into Computer objects first) and scanning all of them
+void measureFlatProducts(size_t products)
+{
+    auto dir = std::filesystem::temp_directory_path();
+    auto text_path = dir / "builder-products.csv", flat_path = dir / "builder-products.flat";
+    {
+        std::ofstream text(text_path, std::ios::binary);
+        FlatComputerWriter writer;
+        for (size_t i = 0; i < products; ++i) {
+            std::string_view cpu = kCatalogCpus[i % kCatalogCpus.size()];
+            auto ram = static_cast<uint32_t>(8 * (1 + i % 64)), storage = static_cast<uint32_t>(256 * (1 + i % 16));
+            text << cpu << ',' << ram << ',' << storage << '\n';
+            writer.setCpu(cpu).setRam(ram).setStorage(storage).build();
+        }
+        writer.save(flat_path);
+    }
+    size_t probe = products / 2;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Computer> computers;
+    {
+        ComputerConfigFile text(text_path);
+        std::vector<ComputerSpec> specs = text.parse(std::thread::hardware_concurrency());
+        computers.reserve(specs.size());
+        for (const ComputerSpec &spec : specs) {
+            computers.push_back(
+                ComputerBuilder().setCpu(std::string(spec.cpu)).setRam(spec.ram).setStorage(spec.storage).build());
+        }
+    }
+    uint32_t text_ram = computers[probe].ram;
+    auto text_first_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    FlatComputerFile flat(flat_path);
+    uint32_t flat_ram = flat[probe].ram();
+    auto flat_first_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    auto scan = [&](auto &&get, size_t count) {
+        auto begin = std::chrono::steady_clock::now();
+        uint64_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            total += get(i);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return std::make_pair(total, count / seconds / 1e6);
+    };
+    start = std::chrono::steady_clock::now();
+    bool verified = flat.verify();
+    auto verify_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    auto [text_total, text_rate] =
+        scan([&](size_t i) { return computers[i].ram + computers[i].cpu.size(); }, computers.size());
+    auto [flat_total, flat_rate] = scan([&](size_t i) { return flat[i].ram() + flat[i].cpu().size(); }, flat.size());
+
+    std::cout << "🗂️ " << products << " products, text " << std::filesystem::file_size(text_path) / (1 << 20)
+              << "MiB vs flat " << flat.bytes() / (1 << 20) << "MiB:" << std::endl;
+    std::cout << "   first access: text -> objects " << std::fixed << std::setprecision(1) << text_first_us / 1000.0
+              << "ms, flat " << std::setprecision(3) << flat_first_us / 1000.0 << "ms (ram " << text_ram << "/"
+              << flat_ram << "); full verify " << std::setprecision(1) << verify_us / 1000.0 << "ms, "
+              << (verified ? "ok" : "failed") << std::endl;
+    std::cout << "   scan: objects " << text_rate << "M products/s, flat " << flat_rate << "M products/s ("
+              << (text_total == flat_total ? "same totals" : "totals differ!") << ")" << std::endl;
+    std::filesystem::remove(text_path);
+    std::filesystem::remove(flat_path);
+}
+
+// Opens flat files whose headers were crafted to pass naive bound checks; each must be rejected on open
+void checkCraftedFlatHeaders()
+{
+    auto path = std::filesystem::temp_directory_path() / "builder-crafted.flat";
+    struct Case {
+        const char *name;
+        uint32_t count;
+        uint64_t strings_offset, strings_bytes;
+    };
+    // Real size: header, one record, 8 string bytes
+    const uint64_t bytes = sizeof(FlatHeader) + sizeof(FlatRecord) + 8;
+    const uint64_t huge_records = sizeof(FlatHeader) + uint64_t{100000000} * sizeof(FlatRecord);
+    const Case cases[] = {
+        {"count=1e8, strings_bytes wraps to the file size", 100000000, huge_records, bytes - huge_records},
+        {"strings_bytes past the end", 1, sizeof(FlatHeader) + sizeof(FlatRecord), 1 << 20},
+        {"strings_offset past the end", 1, UINT64_MAX - 7, 8},
+    };
+    std::cout << "🛡️ Crafted flat headers:" << std::endl;
+    for (const Case &c : cases) {
+        {
+            FlatHeader header{{'C', 'O', 'M', 'P', 'F', 'L', 'A', 'T'}, 1, c.count, sizeof(FlatHeader),
+                              c.strings_offset, c.strings_bytes};
+            FlatRecord record{0, 8, 16, 512};
+            std::ofstream file(path, std::ios::binary);
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+            file.write("Intel i5", 8);
+        }
+        bool rejected = false;
+        try {
+            FlatComputerFile flat(path);
+            rejected = !flat.verify();
+        } catch (const std::runtime_error &) {
+            rejected = true;
+        }
+        std::cout << "   " << c.name << ": " << (rejected ? "rejected" : "ACCEPTED!") << std::endl;
+    }
+    std::filesystem::remove(path);
+}
+
+// Builds a catalog of recipes (cycling through kCatalog) with the parallel director on 1, 2, 4, ... cores
+void measureParallelDirector(size_t recipes)
+{
+    std::vector<ComputerSpec> specs(recipes);
+    for (size_t i = 0; i < recipes; ++i) {
+        specs[i] = kCatalog[i % kCatalogSize];
+    }
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "🏭 Parallel director, " << recipes << " recipes:" << std::endl;
+    double single_ms = 0.0;
+    for (size_t threads = 1;; threads = std::min(threads * 2, cores)) {
+        ThreadPool pool(threads);
+        auto start = std::chrono::steady_clock::now();
+        ProductCatalog catalog = ParallelDirector(pool).construct(specs);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        single_ms = threads == 1 ? ms : single_ms;
+        const ArenaComputer &last = *catalog.products.back();
+        bool matches = last.cpu == specs.back().cpu && last.ram == specs.back().ram;
+        std::cout << "   " << std::setw(3) << threads << " core(s): " << std::fixed << std::setprecision(1) << ms
+                  << "ms, " << recipes / ms / 1e3 << "M products/s, speedup " << std::setprecision(2)
+                  << single_ms / ms << "x" << (matches ? "" : " (mismatch!)") << std::endl;
+        if (threads == cores) {
+            break;
+        }
+    }
+}
 
 int main()
 {
-    std::cout << "Hello, Builder!" << std::endl;
+    std::cout << "🏗️ Builder Pattern Example - Computer Assembly" << std::endl;
+    std::cout << std::string(40, '=') << std::endl;
+
+    ComputerBuilder builder;
+    Computer gaming_pc = Director::constructGamingPc(builder);
+    std::cout << "🎮 Gaming PC: " << gaming_pc << std::endl;
+
+    Computer workstation = Director::constructWorkstation(ComputerBuilder());
+    std::cout << "🖥️ Workstation: " << workstation << std::endl;
+    Computer server = TypedComputerBuilder<>().setCpu("AMD EPYC 9654").setStorage(4000).setRam(768).build();
+    std::cout << "🗄️ Server (typestate): " << server << std::endl;
+    // TypedComputerBuilder<>().setCpu("AMD EPYC 9654").setRam(768).build(); // error: storage not set
+    std::cout << std::endl;
+
+    // Compile-time catalog versus building the same catalog at startup
+    {
+        uint64_t before = AllocationCounter::count();
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Computer> runtime_catalog = buildRuntimeCatalog();
+        auto runtime_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        uint64_t runtime_allocations = AllocationCounter::count() - before;
+
+        bool same = runtime_catalog.size() == kCatalog.size();
+        for (size_t i = 0; same && i < kCatalog.size(); ++i) {
+            same = runtime_catalog[i].cpu == kCatalog[i].cpu && runtime_catalog[i].ram == kCatalog[i].ram &&
+                   runtime_catalog[i].storage == kCatalog[i].storage;
+        }
+
+        std::cout << "📚 Catalog of " << kCatalogSize << " computers:" << std::endl;
+        std::cout << "   built at startup: " << std::fixed << std::setprecision(2) << runtime_us << "us, "
+                  << runtime_allocations << " allocations" << std::endl;
+        std::cout << "   constexpr:        evaluated by the compiler, no startup work (read-only data, "
+                  << sizeof(kCatalog) << " bytes)" << std::endl;
+        std::cout << "   first entry: " << kCatalog[0].toComputer() << "; runtime catalog "
+                  << (same ? "matches" : "DIFFERS") << std::endl;
+    }
+    std::cout << std::endl;
+
+    // A batch of products built into an arena versus one heap object per product
+    constexpr size_t kBatchProducts = 2000000;
+    std::cout << "🧱 Building and freeing a batch of " << kBatchProducts << " products:" << std::endl;
+    std::cout << "   new + std::string: " << measureBatch(kBatchProducts, false) << std::endl;
+    std::cout << "   arena:             " << measureBatch(kBatchProducts, true) << std::endl;
+    std::cout << std::endl;
+
+    // Hash-consed products versus one value per build on a skewed configuration mix
+    constexpr size_t kSkewedProducts = 2000000;
+    std::cout << "🔗 " << kSkewedProducts << " products over 100000 configurations (Zipf 1.1):" << std::endl;
+    std::cout << "   values:   " << measureInterning(kSkewedProducts, 100000, false) << std::endl;
+    std::cout << "   interned: " << measureInterning(kSkewedProducts, 100000, true) << std::endl;
+    std::cout << std::endl;
+
+    // Memory-mapped config file parsed into specs that view the mapping
+    measureConfigParsing(3000000);
+    std::cout << std::endl;
+
+    // Flat product file read in place versus objects built from text
+    measureFlatProducts(2000000);
+    checkCraftedFlatHeaders();
+    std::cout << std::endl;
+
+    // Catalog built across all cores with per-worker builders and arenas
+    measureParallelDirector(10000000);
+    std::cout << std::endl;
+
+    // Move-through fluent chain versus a copy-based builder (the CPU string is created once per build)
+    constexpr size_t kBuilds = 1000000;
+    std::cout << "📦 Building " << kBuilds << " computers:" << std::endl;
+    std::cout << "   copying builder:   " << measureBuilds(kBuilds, [](const std::string &cpu, uint32_t ram) {
+        return CopyingComputerBuilder().setCpu(cpu).setRam(ram).setStorage(1000).build();
+    }) << std::endl;
+    std::cout << "   moving builder:    " << measureBuilds(kBuilds, [](std::string cpu, uint32_t ram) {
+        return ComputerBuilder().setCpu(std::move(cpu)).setRam(ram).setStorage(1000).build();
+    }) << std::endl;
+    std::cout << "   typestate builder: " << measureBuilds(kBuilds, [](std::string cpu, uint32_t ram) {
+        return TypedComputerBuilder<>().setCpu(std::move(cpu)).setRam(ram).setStorage(1000).build();
+    }) << std::endl;
+    std::cout << std::endl;
+
+    std::cout << "✅ Builder Pattern example completed!" << std::endl;
+    std::cout << std::endl;
+    std::cout << "💡 Key Points:" << std::endl;
+    std::cout << "  - Computer is the product, assembled step by step" << std::endl;
+    std::cout << "  - ComputerBuilder sets each part through a fluent interface" << std::endl;
+    std::cout << "  - Director encodes recipes such as the gaming PC" << std::endl;
+    std::cout << "  - Rvalue (&&) setters move the builder's state through the chain without copies" << std::endl;
+    std::cout << "  - TypedComputerBuilder rejects incomplete builds at compile time" << std::endl;
+    std::cout << "  - SpecBuilder and the Director recipes run in constexpr, so catalogs cost nothing at startup"
+              << std::endl;
+    std::cout << "  - ArenaComputerBuilder bump-allocates a batch and frees it in one release()" << std::endl;
+    std::cout << "  - InterningComputerBuilder shares one immutable instance per distinct configuration" << std::endl;
+    std::cout << "  - ComputerConfigFile feeds a mapped config file to SpecBuilder without copying it" << std::endl;
+    std::cout << "  - FlatComputerWriter builds an offset-based file that is read in place after mmap" << std::endl;
+    std::cout << "  - ParallelDirector builds catalogs on a thread pool with per-worker builders and arenas"
+              << std::endl;
     return 0;
-}
\ No newline at end of file
+}